@@ -0,0 +1,90 @@
+# include <stdlib.h>
+# include <string.h>
+# include "base.h"
+# include "arena.h"
+
+static struct ArenaChunk *ArenaChunk_create(const size_t size) {
+    struct ArenaChunk *chunk = malloc(sizeof(struct ArenaChunk) + size);
+    if (!chunk) {
+        panic("out of memory!", 1)
+    }
+    chunk->next = nullptr;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+/// Arena.constructor
+struct Arena *Arena_create() {
+    struct Arena *arena = malloc(sizeof(struct Arena));
+    if (!arena) {
+        panic("out of memory!", 1)
+    }
+    arena->head = ArenaChunk_create(ARENA_CHUNK_SIZE);
+    arena->current = arena->head;
+    return arena;
+}
+
+/// Arena.alloc: aligned for any type, never returns nullptr
+void *Arena_alloc(struct Arena *arena, size_t size) {
+    size = (size + sizeof(max_align_t) - 1) / sizeof(max_align_t) * sizeof(max_align_t);
+    struct ArenaChunk *chunk = arena->current;
+    if (chunk->size - chunk->used < size) {
+        // move to the next kept chunk, or put a new one right after the current
+        if (chunk->next && chunk->next->size >= size) {
+            chunk = chunk->next;
+            chunk->used = 0;
+        } else {
+            struct ArenaChunk *new_chunk = ArenaChunk_create(size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE);
+            new_chunk->next = chunk->next;
+            chunk->next = new_chunk;
+            chunk = new_chunk;
+        }
+        arena->current = chunk;
+    }
+    void *memory = (char *) chunk->data + chunk->used;
+    chunk->used += size;
+    return memory;
+}
+
+char *Arena_strdup(struct Arena *arena, const char *str) {
+    const size_t len = strlen(str) + 1;
+    char *copy = Arena_alloc(arena, len);
+    memcpy(copy, str, len);
+    return copy;
+}
+
+char *Arena_strndup(struct Arena *arena, const char *str, const size_t length) {
+    char *copy = Arena_alloc(arena, length + 1);
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+/// Arena.reset: free everything allocated, O(1), the chunks are reused
+void Arena_reset(struct Arena *arena) {
+    arena->current = arena->head;
+    arena->head->used = 0;
+}
+
+size_t Arena_used(const struct Arena *arena) {
+    size_t used = 0;
+    for (const struct ArenaChunk *chunk = arena->head; chunk; chunk = chunk->next) {
+        used += chunk->used;
+        if (chunk == arena->current) {
+            break;
+        }
+    }
+    return used;
+}
+
+/// Arena.destructor
+void Arena_delete(struct Arena *arena) {
+    struct ArenaChunk *chunk = arena->head;
+    while (chunk) {
+        struct ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
@@ -0,0 +1,41 @@
+# pragma once
+# ifndef ARENA_H
+# define ARENA_H
+# include <stddef.h>
+# include "base.h"
+
+# define ARENA_CHUNK_SIZE (64 * 1024)
+
+struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t size; /// usable bytes in data
+    size_t used;
+    max_align_t data[];
+};
+
+///
+/// Bump allocator.
+///
+/// Everything allocated from it is freed at once by Arena_reset or Arena_delete, there is no single free.
+/// Chunks are kept after a reset and reused, so a steady workload stops calling malloc.
+///
+struct Arena {
+    struct ArenaChunk *head;
+    struct ArenaChunk *current;
+};
+
+struct Arena *Arena_create();
+
+void *Arena_alloc(struct Arena *arena, size_t size);
+
+char *Arena_strdup(struct Arena *arena, const char *str);
+
+char *Arena_strndup(struct Arena *arena, const char *str, size_t length); // copy a slice, NUL terminated
+
+void Arena_reset(struct Arena *arena);
+
+void Arena_delete(struct Arena *arena);
+
+size_t Arena_used(const struct Arena *arena); // bytes in use, for statistics
+
+# endif //ARENA_H
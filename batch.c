@@ -0,0 +1,329 @@
+# include <math.h>
+# include <stdlib.h>
+# include <string.h>
+# include "base.h"
+# include "report.h"
+# include "tokenizer.h"
+# include "parser.h"
+# include "interpreter.h"
+# include "compiler.h"
+# include "symbols.h"
+# include "output.h"
+# include "optimizer.h"
+# include "winzig_calc.h"
+# include "simd.h"
+# include "pool.h"
+# include "batch.h"
+
+// Batch evaluation
+// the front end runs once in WinzigBatch_create, winzig_batch only resets the variables and runs the vm per row
+
+static int *alloc_slots(const int count) {
+    int *slots = malloc(sizeof(int) * (count > 0 ? count : 1));
+    if (!slots) {
+        panic("out of memory!", 1)
+    }
+    return slots;
+}
+
+/// tokenize, parse, resolve, optimize and compile code, with the inputs already defined
+static void WinzigBatch_compile(struct WinzigBatch *batch, const char *code, const char *const *inputs,
+                                const char *const *outputs) {
+    struct WinzigCalc *calc = batch->calc;
+    struct Interpreter *interpreter = calc->interpreter;
+    struct Symbols *symbols = interpreter->symbols;
+
+    for (int i = 0; i < batch->input_count; i++) {
+        batch->input_slots[i] = Symbols_intern(symbols, inputs[i]);
+        symbols->defined[batch->input_slots[i]] = 1;
+    }
+
+    tokenize(calc->tokens, code);
+    if (calc->tokens->error != Success) {
+        report(batch, calc->tokens->error, calc->tokens->message);
+        return;
+    }
+    parse_file(calc->parser, calc->tokens);
+    if (calc->parser->error != Success) {
+        report(batch, calc->parser->error, calc->parser->message);
+        return;
+    }
+    resolve_file(calc->parser, symbols);
+    if (calc->parser->error != Success) {
+        report(batch, calc->parser->error, calc->parser->message);
+        return;
+    }
+    if (calc->optimize) {
+        optimize_file(calc->parser, symbols);
+    }
+
+    for (int i = 0; i < batch->output_count; i++) {
+        batch->output_slots[i] = Symbols_find(symbols, outputs[i]);
+        if (batch->output_slots[i] < 0 || !symbols->defined[batch->output_slots[i]]) {
+            report(batch, SyntaxError, "output variable is never assigned");
+            return;
+        }
+    }
+
+    Program_refresh(interpreter->program);
+    compile_file(interpreter->program, calc->parser->result_block);
+    if (interpreter->program->error != Success) {
+        report(batch, interpreter->program->error, interpreter->program->message);
+        return;
+    }
+
+    Interpreter_reserve(interpreter);
+    batch->initial = malloc(sizeof(Number) * (interpreter->variable_count > 0 ? interpreter->variable_count : 1));
+    if (!batch->initial) {
+        panic("out of memory!", 1)
+    }
+    memset(batch->initial, -1, sizeof(Number) * interpreter->variable_count); // nan, like Interpreter_reserve
+    batch->simd = SimdProgram_create(interpreter->program, interpreter->variable_count);
+    batch->error = Success;
+}
+
+/**
+ * WinzigBatch.constructor: compile a script for batch evaluation
+ *
+ * @param code the script, run once per row
+ * @param inputs names bound to the input columns, in column order
+ * @param outputs names copied to the output columns after each row, they must be assigned by the script
+ * @return the batch, check batch->error before running it
+ */
+struct WinzigBatch *WinzigBatch_create(const char *code, const char *const *inputs, const int input_count,
+                                       const char *const *outputs, const int output_count) {
+    struct WinzigBatch *batch = malloc(sizeof(struct WinzigBatch));
+    if (!batch) {
+        panic("out of memory!", 1)
+    }
+    batch->calc = WinzigCalc_create();
+    batch->input_slots = alloc_slots(input_count);
+    batch->input_count = input_count;
+    batch->output_slots = alloc_slots(output_count);
+    batch->output_count = output_count;
+    batch->initial = nullptr;
+    batch->simd = nullptr;
+    batch->vectorize = 0;
+    batch->seed = RANDOM_SEED;
+    batch->workers = nullptr;
+    batch->worker_count = 0;
+    batch->error = Running;
+    batch->message = nullptr;
+    WinzigBatch_compile(batch, code, inputs, outputs);
+    return batch;
+}
+
+/// WinzigBatch.destructor
+void WinzigBatch_delete(struct WinzigBatch *batch) {
+    WinzigCalc_delete(batch->calc);
+    free(batch->input_slots);
+    free(batch->output_slots);
+    free(batch->initial);
+    if (batch->simd) {
+        SimdProgram_delete(batch->simd);
+    }
+    WinzigBatch_delete_workers(batch);
+    free(batch);
+}
+
+/// random() state of a row, depends only on the seed and the row so any split of the rows gives the same numbers
+static unsigned long long row_seed(const unsigned long long seed, const size_t row) {
+    unsigned long long z = seed + row * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ z >> 30) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ z >> 27) * 0x94d049bb133111ebULL;
+    return z ^ z >> 31;
+}
+
+/// rows [begin, end) on the vm of interpreter, return the row that failed (error in interpreter->error) or end
+static size_t run_rows(const struct WinzigBatch *batch, struct Interpreter *interpreter,
+                       const double *const *in_columns, double *const *out_columns, double *results,
+                       const size_t begin, const size_t end) {
+    const struct Program *program = batch->calc->interpreter->program;
+    Number *const variables = interpreter->variables;
+    const size_t variable_bytes = sizeof(Number) * batch->calc->interpreter->variable_count;
+
+    for (size_t row = begin; row < end; row++) {
+        memcpy(variables, batch->initial, variable_bytes);
+        for (int i = 0; i < batch->input_count; i++) {
+            variables[batch->input_slots[i]] = in_columns[i][row];
+        }
+        interpreter->error = Running;
+        interpreter->random_state = row_seed(batch->seed, row);
+        const Number rv = interpret_Program(interpreter, program);
+        if (interpreter->error != Running) {
+            Output_flush(interpreter->output);
+            return row;
+        }
+        for (int i = 0; i < batch->output_count; i++) {
+            out_columns[i][row] = (double) variables[batch->output_slots[i]];
+        }
+        if (results) {
+            results[row] = (double) rv;
+        }
+    }
+    Output_flush(interpreter->output); // print() of these rows, a chunk at a time with several workers
+    return end;
+}
+
+/// rows [begin, end) on the simd kernels, a block of rows per instruction, return the first row that hit a nan or end
+static size_t run_simd(const struct WinzigBatch *batch, struct SimdProgram *simd,
+                       const double *const *in_columns, double *const *out_columns, double *results,
+                       const size_t begin, const size_t end) {
+    for (size_t row = begin; row < end; row += SIMD_BLOCK) {
+        const int n = end - row < SIMD_BLOCK ? (int) (end - row) : SIMD_BLOCK;
+        for (int i = 0; i < batch->input_count; i++) {
+            memcpy(simd->variables + batch->input_slots[i] * SIMD_BLOCK, in_columns[i] + row, sizeof(double) * n);
+        }
+        const int done = simd_run(simd, n);
+        for (int i = 0; i < batch->output_count; i++) {
+            memcpy(out_columns[i] + row, simd->variables + batch->output_slots[i] * SIMD_BLOCK, sizeof(double) * done);
+        }
+        if (results) {
+            memcpy(results + row, simd->result, sizeof(double) * done);
+        }
+        if (done < n) {
+            return row + done;
+        }
+    }
+    return end;
+}
+
+/**
+ * Run the compiled script once per row
+ *
+ * @param in_columns in_columns[i][row] is the value of inputs[i]
+ * @param out_columns out_columns[i][row] receives outputs[i], may be nullptr if there are no outputs
+ * @param results results[row] receives the value of the last statement, may be nullptr
+ * @param rows number of rows in every column
+ * @return rows evaluated, less than rows if a row failed, batch->error tells why
+ */
+size_t winzig_batch(struct WinzigBatch *batch, const double *const *in_columns, double *const *out_columns,
+                    double *results, const size_t rows) {
+    if (batch->error != Success) {
+        return 0;
+    }
+    if (batch->vectorize && batch->simd) {
+        const size_t done = run_simd(batch, batch->simd, in_columns, out_columns, results, 0, rows);
+        if (done < rows) {
+            report(batch, MathError, NAN_MESSAGE);
+        }
+        return done;
+    }
+    struct Interpreter *interpreter = batch->calc->interpreter;
+    const size_t done = run_rows(batch, interpreter, in_columns, out_columns, results, 0, rows);
+    if (done < rows) {
+        report(batch, interpreter->error, interpreter->message);
+    }
+    return done;
+}
+
+// Parallel batch
+// the compiled program is shared read-only, every worker has its own variables, stack, error and random state
+
+/// make one BatchWorker per pool thread, kept in the batch for the next run
+static void WinzigBatch_prepare_workers(struct WinzigBatch *batch, const int count) {
+    if (batch->worker_count == count) {
+        return;
+    }
+    WinzigBatch_delete_workers(batch);
+    batch->workers = malloc(sizeof(struct BatchWorker) * count);
+    if (!batch->workers) {
+        panic("out of memory!", 1)
+    }
+    const int variable_count = batch->calc->interpreter->variable_count;
+    for (int i = 0; i < count; i++) {
+        struct Interpreter *interpreter = Interpreter_create();
+        interpreter->variables = malloc(sizeof(Number) * (variable_count > 0 ? variable_count : 1));
+        if (!interpreter->variables) {
+            panic("out of memory!", 1)
+        }
+        interpreter->variable_count = variable_count;
+        batch->workers[i].interpreter = interpreter;
+        batch->workers[i].simd = batch->simd ? SimdProgram_create(batch->calc->interpreter->program, variable_count) : nullptr;
+    }
+    batch->worker_count = count;
+}
+
+void WinzigBatch_delete_workers(struct WinzigBatch *batch) {
+    for (int i = 0; i < batch->worker_count; i++) {
+        Interpreter_delete(batch->workers[i].interpreter);
+        if (batch->workers[i].simd) {
+            SimdProgram_delete(batch->workers[i].simd);
+        }
+    }
+    free(batch->workers);
+    batch->workers = nullptr;
+    batch->worker_count = 0;
+}
+
+/// one winzig_batch_parallel call, shared by all workers
+struct BatchJob {
+    struct WinzigBatch *batch;
+    const double *const *in_columns;
+    double *const *out_columns;
+    double *results;
+    pthread_mutex_t lock;
+    size_t failed; /// first failed row so far, rows after it are skipped
+    enum Error error;
+    const char *message;
+};
+
+static void batch_task(void *context, const int worker, const size_t begin, const size_t end) {
+    struct BatchJob *job = context;
+    pthread_mutex_lock(&job->lock);
+    const int skip = begin >= job->failed;
+    pthread_mutex_unlock(&job->lock);
+    if (skip) {
+        return;
+    }
+    struct WinzigBatch *batch = job->batch;
+    struct BatchWorker *state = &batch->workers[worker];
+    size_t stop;
+    enum Error error;
+    const char *message;
+    if (batch->vectorize && state->simd) {
+        stop = run_simd(batch, state->simd, job->in_columns, job->out_columns, job->results, begin, end);
+        error = MathError;
+        message = NAN_MESSAGE;
+    } else {
+        stop = run_rows(batch, state->interpreter, job->in_columns, job->out_columns, job->results, begin, end);
+        error = state->interpreter->error;
+        message = state->interpreter->message;
+    }
+    if (stop < end) {
+        pthread_mutex_lock(&job->lock);
+        if (stop < job->failed) {
+            job->failed = stop;
+            job->error = error;
+            job->message = message;
+        }
+        pthread_mutex_unlock(&job->lock);
+    }
+}
+
+/**
+ * winzig_batch with the rows split over the threads of a pool
+ *
+ * The outputs are the same as from winzig_batch, also for random() and for the row a failure stops at.
+ *
+ * @param pool the threads to use, see Pool_create
+ * @return rows evaluated, every row before it is done, batch->error tells why it stopped early
+ */
+size_t winzig_batch_parallel(struct WinzigBatch *batch, struct Pool *pool, const double *const *in_columns,
+                             double *const *out_columns, double *results, const size_t rows) {
+    if (batch->error != Success) {
+        return 0;
+    }
+    WinzigBatch_prepare_workers(batch, pool->thread_count);
+    struct BatchJob job = {batch, in_columns, out_columns, results};
+    pthread_mutex_init(&job.lock, nullptr);
+    job.failed = rows;
+    job.error = Success;
+    job.message = nullptr;
+    Pool_run(pool, rows, BATCH_CHUNK, batch_task, &job);
+    pthread_mutex_destroy(&job.lock);
+    if (job.failed < rows) {
+        report(batch, job.error, job.message);
+    }
+    return job.failed;
+}
@@ -0,0 +1,64 @@
+# pragma once
+# ifndef BATCH_H
+# define BATCH_H
+# include <stddef.h>
+# include "base.h"
+# include "number.h"
+# include "simd.h"
+
+struct WinzigCalc;
+struct SimdProgram;
+struct Interpreter;
+struct Pool;
+
+# define BATCH_CHUNK (16 * SIMD_BLOCK) /// rows per task in winzig_batch_parallel
+
+/// state of one thread in winzig_batch_parallel
+struct BatchWorker {
+    struct Interpreter *interpreter; /// own variables, stack, error and random state
+    struct SimdProgram *simd; /// own columns, nullptr if the batch can't be vectorized
+};
+
+///
+/// Columnar batch evaluation: compile a script once, then run it for every row of some input columns.
+///
+/// The input names are defined before the script is resolved, so the script can read them without assigning.
+/// Every row starts from the same state: inputs set from the columns, every other variable undefined.
+/// Per row there is no tokenize, parse or compile, only the bytecode vm.
+///
+/// With vectorize set, a script without branches and impure builtins runs SIMD_BLOCK rows at a time
+/// on the kernels in simd.c instead. That path computes in double, not long double.
+///
+/// winzig_batch_parallel splits the rows over a Pool, see pool.h.
+/// random() is seeded from seed and the row number, so the results don't depend on how the rows are split.
+///
+struct WinzigBatch {
+    struct WinzigCalc *calc; /// owns the symbols, the compiled program and the variables
+    int *input_slots;
+    int input_count;
+    int *output_slots;
+    int output_count;
+    Number *initial; /// variables at the start of every row, nan except for inputs
+    struct SimdProgram *simd; /// nullptr if the script can't be vectorized
+    int vectorize; /// use simd when possible, off by default
+    unsigned long long seed; /// random() of every row starts from seed and the row number
+    struct BatchWorker *workers; /// created by the first winzig_batch_parallel
+    int worker_count;
+    enum Error error;
+    const char *message; /// text of the error, see report.h
+};
+
+struct WinzigBatch *WinzigBatch_create(const char *code, const char *const *inputs, int input_count,
+                                       const char *const *outputs, int output_count);
+
+void WinzigBatch_delete(struct WinzigBatch *batch);
+
+void WinzigBatch_delete_workers(struct WinzigBatch *batch); // free the per-thread state, made again when needed
+
+size_t winzig_batch(struct WinzigBatch *batch, const double *const *in_columns, double *const *out_columns,
+                    double *results, size_t rows);
+
+size_t winzig_batch_parallel(struct WinzigBatch *batch, struct Pool *pool, const double *const *in_columns,
+                             double *const *out_columns, double *results, size_t rows);
+
+# endif //BATCH_H
@@ -0,0 +1,146 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "winzig_calc.h"
+#include "batch.h"
+#include "pool.h"
+// Throughput of winzig_batch in rows per second: row by row, vectorized and on all threads
+// usage: batch_bench [rows] [threads]
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/// has a branch, always runs row by row
+static const char *branchy =
+        "d = b * b - 4 * a * c\n"
+        "if (d < 0) { r = 0 } else { r = (sqrt(d) - b) / (2 * a) }\n"
+        "s = r * price + fee\n";
+
+/// straight-line, can be vectorized
+static const char *straight =
+        "d = b * b - 4 * a * c\n"
+        "p = d >= 0\n"
+        "r = p * (sqrt(abs(d)) - b) / (2 * a)\n"
+        "s = r * price + fee\n";
+
+static const char *inputs[] = {"a", "b", "c", "price", "fee"};
+static const char *outputs[] = {"r", "s"};
+
+static struct Pool *pool = nullptr; /// run on the pool instead of the calling thread if set
+
+/// the formula of the scripts in plain C, s of every row into s
+static void reference(double **in, double *s, const size_t rows) {
+    for (size_t row = 0; row < rows; row++) {
+        const double a = in[0][row], b = in[1][row], c = in[2][row];
+        const double d = b * b - 4 * a * c;
+        const double r = d < 0 ? 0 : (sqrt(d) - b) / (2 * a);
+        s[row] = r * in[3][row] + in[4][row];
+    }
+}
+
+/// largest difference of s from the reference, relative to the value (+1 around 0)
+static double max_error(const double *s, const double *expected, const size_t rows) {
+    double max = 0;
+    for (size_t row = 0; row < rows; row++) {
+        const double error = fabs(s[row] - expected[row]) / (fabs(expected[row]) + 1);
+        if (error > max) {
+            max = error;
+        }
+    }
+    return max;
+}
+
+/// run script over the columns, print rows/s and return the seconds taken
+static double run(const char *label, const char *script, const int vectorize,
+                  double **in, double **out, const size_t rows) {
+    struct WinzigBatch *batch = WinzigBatch_create(script, inputs, 5, outputs, 2);
+    if (batch->error != Success) {
+        printf("%s: compile failed: %d\n", label, batch->error);
+        exit(1);
+    }
+    batch->vectorize = vectorize;
+    const double start = now();
+    const size_t done = pool
+                            ? winzig_batch_parallel(batch, pool, (const double *const *) in, out, nullptr, rows)
+                            : winzig_batch(batch, (const double *const *) in, out, nullptr, rows);
+    const double elapsed = now() - start;
+    if (done != rows) {
+        printf("%s: stopped at row %zu: %d\n", label, done, batch->error);
+        exit(1);
+    }
+    double checksum = 0;
+    for (size_t row = 0; row < rows; row++) {
+        checksum += out[1][row];
+    }
+    printf("%-10s %-3d %-6s rows/s: %12.0f  seconds: %.3f  checksum: %f\n", label,
+           pool ? pool->thread_count : 1, vectorize && batch->simd ? "simd" : "rows", rows / elapsed, elapsed, checksum);
+    WinzigBatch_delete(batch);
+    return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    const size_t rows = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000000;
+    const int threads = argc > 2 ? atoi(argv[2]) : 0;
+
+    double *in[5];
+    for (int i = 0; i < 5; i++) {
+        in[i] = malloc(sizeof(double) * rows);
+    }
+    double *out[2] = {malloc(sizeof(double) * rows), malloc(sizeof(double) * rows)};
+    double *expected = malloc(sizeof(double) * rows);
+    srand(42);
+    for (size_t row = 0; row < rows; row++) {
+        in[0][row] = 1 + rand() % 10;
+        in[1][row] = rand() % 100 - 50;
+        in[2][row] = rand() % 100 - 50;
+        in[3][row] = rand() / (double) RAND_MAX * 100;
+        in[4][row] = 0.5;
+    }
+
+    // the checksum of the vm must be the one of plain C, up to rounding (the vm computes in Number)
+    run("branchy", branchy, 0, in, out, rows);
+    reference(in, expected, rows);
+    double checksum = 0;
+    for (size_t row = 0; row < rows; row++) {
+        checksum += expected[row];
+    }
+    const double reference_error = max_error(out[1], expected, rows);
+    printf("C reference checksum: %f  max relative error: %g\n", checksum, reference_error);
+    if (reference_error > 1e-12) {
+        printf("the vm does not match the C reference\n");
+        return 1;
+    }
+
+    const double scalar = run("straight", straight, 0, in, out, rows);
+    for (size_t row = 0; row < rows; row++) {
+        expected[row] = out[1][row];
+    }
+    const double vector = run("straight", straight, 1, in, out, rows);
+
+    printf("simd speedup: %.2fx\n", scalar / vector);
+    printf("max relative error: %g\n", max_error(out[1], expected, rows));
+
+    // the same on every thread, the results must match the single-threaded ones exactly
+    pool = Pool_create(threads);
+    const double parallel = run("straight", straight, 0, in, out, rows);
+    size_t mismatches = 0;
+    for (size_t row = 0; row < rows; row++) {
+        mismatches += out[1][row] != expected[row];
+    }
+    const double parallel_vector = run("straight", straight, 1, in, out, rows);
+    printf("parallel speedup: %.2fx rows, %.2fx simd, %zu mismatched rows\n",
+           scalar / parallel, vector / parallel_vector, mismatches);
+    Pool_delete(pool);
+
+    for (int i = 0; i < 5; i++) {
+        free(in[i]);
+    }
+    free(out[0]);
+    free(out[1]);
+    free(expected);
+    return 0;
+}
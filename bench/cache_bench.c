@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "winzig_calc.h"
+#include "cache.h"
+// winzig_code latency with and without the program cache
+// usage: cache_bench [scripts] [calls] [max bytes]
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/// a formula script of a few dozen statements, different for every index
+static char *make_script(const int index) {
+    const size_t size = 8192;
+    char *script = malloc(size);
+    int used = snprintf(script, size, "x = %d\ny = 1\n", index);
+    for (int i = 0; i < 40; i++) {
+        used += snprintf(script + used, size - used, "y = (y * 3 + x * %d) / (y + %d) + sqrt(x + %d)\n", i + 1, i + 2, i);
+    }
+    return script;
+}
+
+static double run(struct WinzigCalc *calc, char **scripts, const int count, const int calls) {
+    const double start = now();
+    for (int i = 0; i < calls; i++) {
+        winzig_code(calc, scripts[i % count]);
+    }
+    return (now() - start) / calls;
+}
+
+int main(int argc, char *argv[]) {
+    const int count = argc > 1 ? atoi(argv[1]) : 16;
+    const int calls = argc > 2 ? atoi(argv[2]) : 100000;
+    const size_t max_bytes = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1 << 20;
+
+    char **scripts = malloc(sizeof(char *) * count);
+    for (int i = 0; i < count; i++) {
+        scripts[i] = make_script(i);
+    }
+
+    struct WinzigCalc *calc = WinzigCalc_create();
+    calc->print_ast = 0;
+    const double uncached = run(calc, scripts, count, calls);
+    WinzigCalc_enable_cache(calc, max_bytes);
+    const double cached = run(calc, scripts, count, calls);
+
+    const struct ProgramCache *cache = calc->cache;
+    printf("scripts: %d, calls: %d, max bytes: %zu\n", count, calls, max_bytes);
+    printf("uncached: %.2f us/call\n", uncached * 1e6);
+    printf("cached:   %.2f us/call (%.1fx)\n", cached * 1e6, uncached / cached);
+    printf("hits: %llu, misses: %llu, evictions: %llu, entries: %d, bytes: %zu\n",
+           cache->hits, cache->misses, cache->evictions, cache->count, cache->bytes);
+
+    WinzigCalc_delete(calc);
+    for (int i = 0; i < count; i++) {
+        free(scripts[i]);
+    }
+    free(scripts);
+    return 0;
+}
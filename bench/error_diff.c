@@ -0,0 +1,123 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "winzig_calc.h"
+#include "interpreter.h"
+#include "output.h"
+#include "input.h"
+#include "symbols.h"
+#include "jit.h"
+// Error check: scripts that fail on the way run in the vm, the tree walker and ModeJit (loops compiled at once, and
+// after 2 walked iterations). The printed text, the error and every variable must be the same, so every mode stops
+// at the same place.
+// usage: error_diff [files...]
+
+struct Text {
+    char *data;
+    size_t length;
+    size_t size;
+};
+
+static void collect(void *context, const char *data, const size_t length) {
+    struct Text *text = context;
+    if (text->length + length + 1 > text->size) {
+        text->size = (text->length + length + 1) * 2;
+        text->data = realloc(text->data, text->size);
+    }
+    memcpy(text->data + text->length, data, length);
+    text->length += length;
+    text->data[text->length] = '\0';
+}
+
+static const char *scripts[] = {
+    "y = 0/0\nprint(5)\nprint(6)\n",
+    "exit(0)\nprint(1)\n",
+    "print(1)\nexit(0)\nprint(2)\n",
+    "x = 1\nx += 0/0\nprint(7)\n",
+    "x = 0\ny = 0\nz = (x = 0/0) + print(3)\ny = 1\n",
+    "i = 0\nwhile (i < 10) {\nprint(i)\ni += 1\nx = (i - 3) / (i - 3)\n}\nprint(x)\n",
+    "a = 0\ni = 0\nwhile (i < 50) {\na /= abs(i - 1)\ni += 1\n}\nprint(a)\n",
+    "i = 0\ns = 0\nwhile (i < 100) {\ns += 1 / (50 - i) * 0\ni += 1\n}\nprint(s)\n",
+    "i = 0\nj = 0\nwhile (i < 5) {\nj = 0\nwhile (j < 5) {\nx = j / (j - 2 - i)\nj += 1\n}\ni += 1\n}\nprint(i)\n",
+    "i = 0\nx = 1\nwhile ((x = x - 0.25) >= 0 | i < 8) {\ni += 1\nx = x * sqrt(x)\n}\nprint(i)\n",
+    "a = 1\nif (a) {\nb = 0/0\nprint(1)\n} else {\nprint(2)\n}\nprint(3)\n",
+    "a = 0/0 < 1\nif ((a = 0/0) > 1) {\nprint(1)\n} else {\nprint(2)\n}\n",
+    "x = 2\ny = sqrt(0 - x)\nprint(y)\n",
+    "i = 0\nwhile (i < 3) {\nprint(i)\ni += 1\nif (i == 2) {\nexit(0)\n}\n}\nprint(9)\n",
+    "x = input()\nprint(x)\ny = input()\nprint(y)\n",
+    "x = input() + input()\nprint(x)\n",
+    "i = 0\nwhile (i < 4) {\ni += 1\nx = input()\nprint(x)\n}\n",
+};
+
+# define MODES 4
+
+static const char *modes[MODES] = {"vm", "walk", "jit", "jit after 2"};
+
+static int same(const Number x, const Number y) {
+    return x == y || (isnan(x) && isnan(y));
+}
+
+/// run script in every mode, 1 if anything differs from the vm
+static int compare(const char *name, const char *script) {
+    struct WinzigCalc *calcs[MODES];
+    struct Text texts[MODES] = {0};
+    for (int k = 0; k < MODES; k++) {
+        calcs[k] = WinzigCalc_create();
+        calcs[k]->print_ast = 0;
+        calcs[k]->error_output = nullptr;
+        calcs[k]->interpreter->mode = k == 0 ? ModeBytecode : k == 1 ? ModeTreeWalk : ModeJit;
+        calcs[k]->interpreter->jit->threshold = k == 3 ? 2 : 0;
+        Output_set_callback(calcs[k]->interpreter->output, collect, &texts[k]);
+        Input_set_memory(calcs[k]->interpreter->input, "4 x 5", 5); // a word that is not a number fails input()
+        winzig_code(calcs[k], (char *) script);
+    }
+    int differs = 0;
+    for (int k = 1; k < MODES; k++) {
+        int wrong = calcs[0]->error != calcs[k]->error ||
+                    strcmp(texts[0].data ? texts[0].data : "", texts[k].data ? texts[k].data : "") != 0;
+        const struct Symbols *symbols = calcs[0]->interpreter->symbols;
+        for (int slot = 0; slot < symbols->count && slot < calcs[k]->interpreter->variable_count; slot++) {
+            if (symbols->names[slot][0] != '$' &&
+                !same(calcs[0]->interpreter->variables[slot], calcs[k]->interpreter->variables[slot])) {
+                wrong = 1;
+            }
+        }
+        if (wrong) {
+            printf("--- %s: %s differs from vm\n%s--- vm (error %d):\n%s--- %s (error %d):\n%s", name, modes[k], script,
+                   calcs[0]->error, texts[0].data ? texts[0].data : "", modes[k], calcs[k]->error,
+                   texts[k].data ? texts[k].data : "");
+        }
+        differs |= wrong;
+    }
+    for (int k = 0; k < MODES; k++) {
+        WinzigCalc_delete(calcs[k]);
+        free(texts[k].data);
+    }
+    return differs;
+}
+
+int main(int argc, char *argv[]) {
+    const int count = (int) (sizeof(scripts) / sizeof(scripts[0]));
+    int mismatches = 0;
+    for (int i = 0; i < count; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "script %d", i);
+        mismatches += compare(name, scripts[i]);
+    }
+    for (int i = 1; i < argc; i++) {
+        FILE *file = fopen(argv[i], "r");
+        if (!file) {
+            printf("cannot open %s\n", argv[i]);
+            mismatches++;
+            continue;
+        }
+        char *script = calloc(1 << 20, 1);
+        fread(script, 1, (1 << 20) - 1, file);
+        fclose(file);
+        mismatches += compare(argv[i], script);
+        free(script);
+    }
+    printf("scripts: %d, differ: %d\n", count + argc - 1, mismatches);
+    return mismatches != 0;
+}
@@ -0,0 +1,199 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "winzig_calc.h"
+#include "interpreter.h"
+#include "output.h"
+#include "symbols.h"
+#include "jit.h"
+// Differential runner: every script runs in the tree walker and in ModeJit, printed text, error and every variable
+// must be the same. Scripts are random loops over a few variables, plus any files given on the command line.
+// usage: jit_diff [scripts] [seed] [files...]
+
+struct Text {
+    char *data;
+    size_t length;
+    size_t size;
+};
+
+static void collect(void *context, const char *data, const size_t length) {
+    struct Text *text = context;
+    if (text->length + length + 1 > text->size) {
+        text->size = (text->length + length + 1) * 2;
+        text->data = realloc(text->data, text->size);
+    }
+    memcpy(text->data + text->length, data, length);
+    text->length += length;
+    text->data[text->length] = '\0';
+}
+
+static unsigned long long state;
+
+static int roll(const int n) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (int) (state % n);
+}
+
+static const char *variables[] = {"a", "b", "c", "d"};
+
+static int put_expression(char *out, const int depth) {
+    if (depth <= 0 || roll(3) == 0) {
+        if (roll(2)) {
+            return sprintf(out, "%s", variables[roll(4)]);
+        }
+        return sprintf(out, "%d.%d", roll(20), roll(100));
+    }
+    static const char *ops[] = {"+", "-", "*", "/", "<", "<=", ">", ">=", "==", "!=", "&", "|"};
+    static const char *assigns[] = {"=", "+=", "-=", "*=", "&=", "|="};
+    switch (roll(9)) {
+        case 0:
+            return sprintf(out, "sqrt(abs(i))");
+        case 1: {
+            int n = sprintf(out, "floor(");
+            n += put_expression(out + n, depth - 1);
+            return n + sprintf(out + n, ")");
+        }
+        case 2: {
+            int n = sprintf(out, "abs(");
+            n += put_expression(out + n, depth - 1);
+            return n + sprintf(out + n, ")");
+        }
+        case 3: {
+            // an assignment inside the expression, a short-circuit & | around it decides whether it runs
+            int n = sprintf(out, "(%s %s ", variables[roll(4)], assigns[roll(6)]);
+            n += put_expression(out + n, depth - 1);
+            return n + sprintf(out + n, ")");
+        }
+        default: {
+            int n = sprintf(out, "(");
+            n += put_expression(out + n, depth - 1);
+            n += sprintf(out + n, " %s ", ops[roll(12)]);
+            n += put_expression(out + n, depth - 1);
+            return n + sprintf(out + n, ")");
+        }
+    }
+}
+
+static int put_statement(char *out, const int depth) {
+    static const char *assigns[] = {"=", "+=", "-=", "*=", "/=", "&=", "|="};
+    if (depth > 0 && roll(5) == 0) {
+        int n = sprintf(out, "if (");
+        n += put_expression(out + n, 2);
+        n += sprintf(out + n, ") {\n");
+        n += put_statement(out + n, depth - 1);
+        n += sprintf(out + n, "} else {\n");
+        n += put_statement(out + n, depth - 1);
+        return n + sprintf(out + n, "}\n");
+    }
+    if (depth > 0 && roll(8) == 0) {
+        const char *counter = depth > 1 ? "j" : "k"; // a nested while must not reset the counter of the outer one
+        int n = sprintf(out, "%s = 0\nwhile (%s < %d) {\n", counter, counter, roll(5));
+        n += put_statement(out + n, depth - 1);
+        return n + sprintf(out + n, "%s += 1\n}\n", counter);
+    }
+    int n = sprintf(out, "%s %s ", variables[roll(4)], assigns[roll(7)]);
+    n += put_expression(out + n, 2);
+    return n + sprintf(out + n, "\n");
+}
+
+/// a while over i with random statements, an occasional ^ or print keeps the loop in the walker
+static char *make_script() {
+    char *script = malloc(65536);
+    int n = sprintf(script, "a = %d\nb = %d.5\nc = 0\nd = 1\nj = 0\nk = 0\ni = 0\nwhile (i < %d) {\n", roll(9), roll(9), roll(300));
+    const int count = 1 + roll(6);
+    for (int k = 0; k < count; k++) {
+        n += put_statement(script + n, 2);
+    }
+    if (roll(10) == 0) {
+        n += sprintf(script + n, "d = d ^ 1\n");
+    }
+    if (roll(10) == 0) {
+        n += sprintf(script + n, "print(a)\n");
+    }
+    sprintf(script + n, "i += 1\n}\nprint(a)\nprint(b)\nprint(c)\nprint(d)\n");
+    return script;
+}
+
+static int compiled, rejected;
+
+static int same(const Number x, const Number y) {
+    return x == y || (isnan(x) && isnan(y));
+}
+
+/// run script in both modes, 1 if anything differs
+static int compare(const char *script, const int threshold, int *skipped) {
+    struct WinzigCalc *calcs[2];
+    struct Text texts[2] = {0};
+    for (int k = 0; k < 2; k++) {
+        calcs[k] = WinzigCalc_create();
+        calcs[k]->print_ast = 0;
+        calcs[k]->error_output = nullptr;
+        calcs[k]->interpreter->mode = k == 0 ? ModeTreeWalk : ModeJit;
+        calcs[k]->interpreter->jit->threshold = threshold;
+        Output_set_callback(calcs[k]->interpreter->output, collect, &texts[k]);
+        winzig_code(calcs[k], (char *) script);
+    }
+    int differs = calcs[0]->error != calcs[1]->error ||
+                  (texts[0].data && texts[1].data ? strcmp(texts[0].data, texts[1].data) != 0 : texts[0].data != texts[1].data);
+    if (calcs[0]->error == SyntaxError) {
+        (*skipped)++;
+    } else {
+        const struct Symbols *symbols = calcs[0]->interpreter->symbols;
+        for (int slot = 0; slot < symbols->count && slot < calcs[1]->interpreter->variable_count; slot++) {
+            if (!same(calcs[0]->interpreter->variables[slot], calcs[1]->interpreter->variables[slot])) {
+                differs = 1;
+            }
+        }
+    }
+    if (differs) {
+        printf("--- mismatch (threshold %d):\n%s--- walk: %s--- jit: %s\n", threshold, script,
+               texts[0].data ? texts[0].data : "\n", texts[1].data ? texts[1].data : "\n");
+    }
+    compiled += calcs[1]->interpreter->jit->compiled;
+    rejected += calcs[1]->interpreter->jit->rejected;
+    for (int k = 0; k < 2; k++) {
+        WinzigCalc_delete(calcs[k]);
+        free(texts[k].data);
+    }
+    return differs;
+}
+
+int main(int argc, char *argv[]) {
+    const int count = argc > 1 ? atoi(argv[1]) : 2000;
+    state = argc > 2 ? strtoull(argv[2], nullptr, 10) * 2 + 1 : 88172645463325252ULL;
+    int mismatches = 0;
+    int skipped = 0;
+    for (int i = 3; i < argc; i++) {
+        FILE *file = fopen(argv[i], "r");
+        if (!file) {
+            printf("cannot open %s\n", argv[i]);
+            continue;
+        }
+        char *script = calloc(1 << 20, 1);
+        fread(script, 1, (1 << 20) - 1, file);
+        fclose(file);
+        mismatches += compare(script, 0, &skipped);
+        free(script);
+    }
+    for (int i = 0; i < count; i++) {
+        char *script = make_script();
+        mismatches += compare(script, roll(2) ? 0 : roll(50), &skipped);
+        free(script);
+    }
+
+    struct WinzigCalc *probe = WinzigCalc_create();
+    probe->print_ast = 0;
+    probe->interpreter->mode = ModeJit;
+    probe->interpreter->jit->threshold = 0;
+    winzig_code(probe, "i = 0\nwhile (i < 1) {\ni += 1\n}\n");
+    const int native = probe->interpreter->jit->compiled > 0;
+    WinzigCalc_delete(probe);
+
+    printf("scripts: %d, mismatches: %d, syntax errors skipped: %d\n", count + (argc > 3 ? argc - 3 : 0), mismatches, skipped);
+    printf("loops compiled: %d, rejected: %d, jit: %s\n", compiled, rejected,
+           native ? "native" : "not available in this build, walker only");
+    return mismatches != 0;
+}
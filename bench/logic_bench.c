@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "winzig_calc.h"
+#include "interpreter.h"
+// guard-heavy while loops with short-circuit & and |, against the same guards chained with * and + (always evaluated)
+// usage: logic_bench [iterations] [--walk]
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/// a loop whose if condition has a cheap guard first and expensive ones after it, op joins them
+static char *make_script(const int iterations, const char *and_op, const char *or_op) {
+    char *script = malloc(1024);
+    snprintf(script, 1024,
+             "i = 0\n"
+             "hits = 0\n"
+             "while (i < %d) {\n"
+             "    if ((i - floor(i / 8) * 8 < 1) %s (sqrt(i) + log(i + 1) > 3) %s (sin(i) * cos(i) < 0.4))\n"
+             "        hits += 1\n"
+             "    if ((i > 1) %s (exp(sin(i)) > 0.5) %s (atan(i) > 0.1))\n"
+             "        hits += 1\n"
+             "    i += 1\n"
+             "}\n"
+             "hits\n",
+             iterations, and_op, and_op, or_op, or_op);
+    return script;
+}
+
+static int run(struct WinzigCalc *calc, char *script, double *seconds) {
+    const double start = now();
+    winzig_code(calc, script);
+    *seconds = now() - start;
+    return calc->error == Success ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    struct WinzigCalc *calc = WinzigCalc_create();
+    calc->print_ast = 0;
+    if (argc > 2) {
+        calc->interpreter->mode = ModeTreeWalk;
+    }
+
+    char *lazy = make_script(iterations, "&", "|");
+    char *eager = make_script(iterations, "*", "+");
+    double lazy_seconds, eager_seconds;
+    if (run(calc, lazy, &lazy_seconds) < 0 || run(calc, eager, &eager_seconds) < 0) {
+        printf("failed: %s\n", calc->message);
+        return 1;
+    }
+    printf("iterations: %d, mode: %s\n", iterations, argc > 2 ? "walk" : "bytecode");
+    printf("short-circuit: %.3f s\n", lazy_seconds);
+    printf("eager:         %.3f s (%.2fx)\n", eager_seconds, eager_seconds / lazy_seconds);
+
+    free(lazy);
+    free(eager);
+    WinzigCalc_delete(calc);
+    return 0;
+}
@@ -0,0 +1,223 @@
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "base.h"
+// Number type check: every script runs through calc (long double) and calc_double, the printed text must be
+// the same except for numbers, which must agree within the tolerance of the README (RELATIVE or ABSOLUTE).
+// A print of every assigned variable is appended, so scripts that print little still compare their results.
+// usage: number_diff <calc> <calc_double> [--suite <bench_suite> <size>] [files...]
+//        --suite also checks the scripts of bench_suite --generate for every kind
+
+# define RELATIVE 1e-9
+# define ABSOLUTE 1e-6 // the last of the 6 printed decimals
+
+static const char *kinds[] = {"mixed", "loop", "builtin", "assign", "formula"};
+
+struct Text {
+    char *data;
+    size_t length;
+};
+
+/// the whole output of a command, stdout and stderr
+static struct Text run(const char *command) {
+    struct Text text = {nullptr, 0};
+    FILE *pipe = popen(command, "r");
+    if (!pipe) {
+        return text;
+    }
+    size_t size = 0;
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), pipe)) > 0) {
+        if (text.length + n + 1 > size) {
+            size = (text.length + n + 1) * 2;
+            text.data = realloc(text.data, size);
+        }
+        memcpy(text.data + text.length, chunk, n);
+        text.length += n;
+    }
+    pclose(pipe);
+    if (text.data) {
+        text.data[text.length] = '\0';
+    }
+    return text;
+}
+
+static int same_number(const double x, const double y) {
+    if (isnan(x) || isnan(y)) {
+        return isnan(x) && isnan(y);
+    }
+    if (isinf(x) || isinf(y)) {
+        return x == y;
+    }
+    const double difference = fabs(x - y);
+    return difference <= ABSOLUTE || difference <= RELATIVE * fmax(fabs(x), fabs(y));
+}
+
+static int is_name_char(const char c) {
+    return isalnum((unsigned char) c) || c == '_';
+}
+
+/// compare two outputs, numbers within the tolerance and every other character exactly; print the first difference
+static int compare(const char *name, const char *a, const char *b) {
+    const char *start_a = a;
+    int line = 1;
+    while (*a && *b) {
+        const int boundary = a == start_a || !is_name_char(a[-1]);
+        if (boundary && !isspace((unsigned char) *a) && !isspace((unsigned char) *b)) {
+            char *end_a;
+            char *end_b;
+            const double x = strtod(a, &end_a);
+            const double y = strtod(b, &end_b);
+            if (end_a != a && end_b != b) {
+                if (!same_number(x, y)) {
+                    printf("%s:%d: %.*s vs %.*s\n", name, line, (int) (end_a - a), a, (int) (end_b - b), b);
+                    return 1;
+                }
+                a = end_a;
+                b = end_b;
+                continue;
+            }
+        }
+        if (*a != *b) {
+            break;
+        }
+        line += *a == '\n';
+        a++;
+        b++;
+    }
+    if (*a || *b) {
+        printf("%s:%d: text differs: \"%.40s\" vs \"%.40s\"\n", name, line, a, b);
+        return 1;
+    }
+    return 0;
+}
+
+/// the script, then print() of every variable assigned at the start of a line, in a temporary file
+static int with_prints(const char *script, char *path) {
+    strcpy(path, "/tmp/number_diff_XXXXXX");
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        return 0;
+    }
+    FILE *file = fdopen(fd, "w");
+    fputs(script, file);
+    fputs("\n", file);
+    char **names = nullptr;
+    int count = 0;
+    for (const char *line = script; line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : nullptr) {
+        while (*line == ' ' || *line == '\t') {
+            line++;
+        }
+        const char *end = line;
+        while (is_name_char(*end)) {
+            end++;
+        }
+        const char *op = end;
+        while (*op == ' ') {
+            op++;
+        }
+        const int assign = (op[0] == '=' && op[1] != '=') || (op[0] && strchr("+-*/^&|", op[0]) && op[1] == '=');
+        if (end == line || isdigit((unsigned char) *line) || !assign) {
+            continue;
+        }
+        int seen = 0;
+        for (int i = 0; i < count; i++) {
+            seen |= strlen(names[i]) == (size_t) (end - line) && strncmp(names[i], line, end - line) == 0;
+        }
+        if (!seen) {
+            names = realloc(names, sizeof(char *) * (count + 1));
+            names[count++] = strndup(line, end - line);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        fprintf(file, "print(%s)\n", names[i]);
+        free(names[i]);
+    }
+    free(names);
+    fclose(file);
+    return 1;
+}
+
+/// 1 if the two builds print different results for the script
+static int check(const char *calc, const char *calc_double, const char *name, const char *script) {
+    char path[64];
+    if (!with_prints(script, path)) {
+        printf("%s: cannot write a temporary file\n", name);
+        return 1;
+    }
+    char command[4096];
+    snprintf(command, sizeof(command), "'%s' '%s' < /dev/null 2>&1", calc, path);
+    struct Text a = run(command);
+    snprintf(command, sizeof(command), "'%s' '%s' < /dev/null 2>&1", calc_double, path);
+    struct Text b = run(command);
+    unlink(path);
+    int differs;
+    if (!a.data || !b.data) {
+        printf("%s: no output, check the paths of calc and calc_double\n", name);
+        differs = 1;
+    } else {
+        differs = compare(name, a.data, b.data);
+    }
+    free(a.data);
+    free(b.data);
+    return differs;
+}
+
+static char *read_file(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        return nullptr;
+    }
+    fseek(file, 0, SEEK_END);
+    const long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *data = malloc(length + 1);
+    data[fread(data, 1, length, file)] = '\0';
+    fclose(file);
+    return data;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        printf("usage: number_diff <calc> <calc_double> [--suite <bench_suite> <size>] [files...]\n");
+        return 2;
+    }
+    int scripts = 0;
+    int failures = 0;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--suite") == 0 && i + 2 < argc) {
+            for (int k = 0; k < (int) (sizeof(kinds) / sizeof(kinds[0])); k++) {
+                char command[4096];
+                snprintf(command, sizeof(command), "'%s' --generate %s %d", argv[i + 1], kinds[k], atoi(argv[i + 2]));
+                struct Text script = run(command);
+                if (!script.data) {
+                    printf("cannot run %s\n", argv[i + 1]);
+                    failures++;
+                    continue;
+                }
+                char name[64];
+                snprintf(name, sizeof(name), "generated %s", kinds[k]);
+                failures += check(argv[1], argv[2], name, script.data);
+                scripts++;
+                free(script.data);
+            }
+            i += 2;
+            continue;
+        }
+        char *script = read_file(argv[i]);
+        if (!script) {
+            printf("cannot open %s\n", argv[i]);
+            failures++;
+            continue;
+        }
+        failures += check(argv[1], argv[2], argv[i], script);
+        scripts++;
+        free(script);
+    }
+    printf("scripts: %d, differ: %d (tolerance %g relative or %g absolute)\n", scripts, failures, RELATIVE, ABSOLUTE);
+    return failures != 0;
+}
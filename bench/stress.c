@@ -0,0 +1,96 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "winzig_calc.h"
+#include "interpreter.h"
+#include "output.h"
+#include "input.h"
+// Many independent WinzigCalc instances on many threads at once.
+// Every instance prints into its own memory stream and reads from its own input,
+// the output must be the same as from a single instance alone.
+// usage: stress [threads] [instances per thread] [rounds]
+
+static const char *script =
+        "n = input(0)\n"
+        "i = 0\n"
+        "s = 0\n"
+        "while (i < 200) { s += random(0) * n; i += 1 }\n"
+        "print(s)\n"
+        "print(sqrt(n) + n ^ 2)\n";
+
+static const char *input = "7\n";
+
+/// one instance, one script run, the printed text in a malloc'd string
+static char *run_once(struct WinzigCalc *calc) {
+    char *text = nullptr;
+    size_t length = 0;
+    FILE *output = open_memstream(&text, &length);
+    Output_set_file(calc->interpreter->output, output);
+    Input_set_memory(calc->interpreter->input, input, strlen(input));
+    calc->interpreter->random_state = RANDOM_SEED;
+    winzig_code(calc, (char *) script);
+    Output_set_file(calc->interpreter->output, stdout); // the memory stream is closed below
+    fclose(output);
+    return text;
+}
+
+static char *expected = nullptr;
+static int instances = 250;
+static int rounds = 4;
+
+static void *stress_thread(void *arg) {
+    long *failures = arg;
+    struct WinzigCalc **calcs = malloc(sizeof(struct WinzigCalc *) * instances);
+    for (int i = 0; i < instances; i++) {
+        calcs[i] = WinzigCalc_create();
+        calcs[i]->print_ast = 0;
+        calcs[i]->error_output = nullptr;
+    }
+    // every instance is alive for the whole run, the rounds interleave them
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < instances; i++) {
+            char *text = run_once(calcs[i]);
+            if (calcs[i]->error != Success || strcmp(text, expected) != 0) {
+                (*failures)++;
+            }
+            free(text);
+        }
+    }
+    for (int i = 0; i < instances; i++) {
+        WinzigCalc_delete(calcs[i]);
+    }
+    free(calcs);
+    return nullptr;
+}
+
+int main(int argc, char *argv[]) {
+    const int threads = argc > 1 ? atoi(argv[1]) : 8;
+    instances = argc > 2 ? atoi(argv[2]) : instances;
+    rounds = argc > 3 ? atoi(argv[3]) : rounds;
+
+    struct WinzigCalc *reference = WinzigCalc_create();
+    reference->print_ast = 0;
+    expected = run_once(reference);
+    if (reference->error != Success) {
+        printf("reference run failed: %s\n", reference->message);
+        return 1;
+    }
+    WinzigCalc_delete(reference);
+
+    pthread_t *ids = malloc(sizeof(pthread_t) * threads);
+    long *failures = calloc(threads, sizeof(long));
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&ids[i], nullptr, stress_thread, &failures[i]);
+    }
+    long total = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(ids[i], nullptr);
+        total += failures[i];
+    }
+    printf("instances: %d, runs: %ld, failures: %ld\n", threads * instances, (long) threads * instances * rounds, total);
+    free(ids);
+    free(failures);
+    free(expected);
+    return total != 0;
+}
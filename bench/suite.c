@@ -0,0 +1,383 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "winzig_calc.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "symbols.h"
+#include "optimizer.h"
+#include "interpreter.h"
+// The benchmark suite: tokenize, parse_file, interpret_Block and the vm on generated workloads, winzig_code latency.
+// Scripts come from a seeded generator, so every run measures the same input.
+// usage: bench_suite [--json] [--output file] [--size n] [--repeat n] [--seed n] [--filter name]
+//        bench_suite --generate mixed|loop|builtin|assign|formula n   (print a script of size n and exit)
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long long state;
+
+static int roll(const int n) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (int) (state % n);
+}
+
+/// a growing string for the generator
+struct Script {
+    char *text;
+    size_t length;
+    size_t size;
+};
+
+static void put(struct Script *script, const char *format, ...) {
+    va_list args;
+    while (1) {
+        va_start(args, format);
+        const int n = vsnprintf(script->text + script->length, script->size - script->length, format, args);
+        va_end(args);
+        if (script->length + n < script->size) {
+            script->length += n;
+            return;
+        }
+        script->size = script->size * 2 + n;
+        script->text = realloc(script->text, script->size);
+        if (!script->text) {
+            panic("out of memory!", 1)
+        }
+    }
+}
+
+static const char *names[] = {"a", "b", "c", "d", "x", "y", "z", "w"};
+
+static void put_formula(struct Script *script, const int depth) {
+    if (depth <= 0 || roll(4) == 0) {
+        if (roll(2)) {
+            put(script, "%s", names[roll(8)]);
+        } else {
+            put(script, "%d.%d", roll(100), roll(10));
+        }
+        return;
+    }
+    static const char *ops[] = {"+", "-", "*", "/", "+", "*", "<", ">"};
+    static const char *functions[] = {"sqrt", "abs", "sin", "floor"};
+    if (roll(5) == 0) {
+        put(script, "%s(", functions[roll(4)]);
+        put_formula(script, depth - 1);
+        put(script, ")");
+        return;
+    }
+    put(script, "(");
+    put_formula(script, depth - 1);
+    put(script, " %s ", ops[roll(8)]);
+    put_formula(script, depth - 1);
+    put(script, ")");
+}
+
+/**
+ * A synthetic script
+ *
+ * mixed: size statements of assignments, ifs and short whiles, for the front end
+ * loop: a nested while, size outer iterations of 8 inner ones
+ * builtin: size iterations calling sqrt, sin, cos, floor and abs
+ * assign: size iterations of plain and compound assignments
+ * formula: size assignments that always compute a number, for winzig_code
+ */
+static char *generate(const char *kind, const int size) {
+    struct Script script = {malloc(4096), 0, 4096};
+    if (strcmp(kind, "mixed") == 0) {
+        put(&script, "a = 1\nb = 2\nc = 3\nd = 4\nx = 5\ny = 6\nz = 7\nw = 8\n");
+        for (int i = 0; i < size; i++) {
+            const int pick = roll(10);
+            if (pick == 0) {
+                put(&script, "if (");
+                put_formula(&script, 2);
+                put(&script, ") {\n%s = ", names[roll(8)]);
+                put_formula(&script, 3);
+                put(&script, "\n} else {\n%s += 1\n}\n", names[roll(8)]);
+            } else if (pick == 1) {
+                put(&script, "k = 0\nwhile (k < 3) {\n%s -= ", names[roll(8)]);
+                put_formula(&script, 2);
+                put(&script, "\nk += 1\n}\n");
+            } else {
+                put(&script, "%s %s ", names[roll(8)], roll(3) ? "=" : "+=");
+                put_formula(&script, 4);
+                put(&script, "\n");
+            }
+        }
+    } else if (strcmp(kind, "loop") == 0) {
+        put(&script, "i = 0\ns = 0\nwhile (i < %d) {\n"
+                     "    j = 0\n"
+                     "    while (j < 8) {\n"
+                     "        s += j * i - s / 7\n"
+                     "        j += 1\n"
+                     "    }\n"
+                     "    i += 1\n"
+                     "}\n", size);
+    } else if (strcmp(kind, "builtin") == 0) {
+        put(&script, "i = 0\ns = 0\nwhile (i < %d) {\n"
+                     "    s += sqrt(i) + sin(i) * cos(i) + floor(i / 3) + abs(sin(i) - 0.5)\n"
+                     "    i += 1\n"
+                     "}\n", size);
+    } else if (strcmp(kind, "assign") == 0) {
+        put(&script, "i = 0\na = 0\nb = 1\nc = 2\nd = 3\nwhile (i < %d) {\n"
+                     "    a = i + 1\n"
+                     "    b = a * 2 - 1\n"
+                     "    c = b - a / 4\n"
+                     "    d += c - b\n"
+                     "    a -= d / 8\n"
+                     "    b *= 0.5\n"
+                     "    c = a + b + d\n"
+                     "    i += 1\n"
+                     "}\n", size);
+    } else if (strcmp(kind, "formula") == 0) {
+        put(&script, "x = 3\ny = 1\n");
+        for (int i = 0; i < size; i++) {
+            put(&script, "y = (y * 3 + x * %d) / (y + %d) + sqrt(x + %d)\n", i + 1, i + 2, i);
+        }
+    } else {
+        free(script.text);
+        return nullptr;
+    }
+    return script.text;
+}
+
+static int count_Block(const struct Block *block);
+
+static int count_Expression(const struct Expression *expr) {
+    switch (expr->tag) {
+        case GExpr2: return 1 + count_Expression(expr->expr2->lhs) + count_Expression(expr->expr2->rhs);
+        case GExpr1: return 1 + count_Expression(expr->expr1->expr);
+        case GBuiltin: return 1 + count_Expression(expr->builtin->expr);
+        default: return 1;
+    }
+}
+
+/// statements and expressions of a parsed block
+static int count_Block(const struct Block *block) {
+    int nodes = 0;
+    for (struct Statement **stmt = block->stmts; stmt[0]->tag != GNull; stmt++) {
+        nodes++;
+        switch (stmt[0]->tag) {
+            case GExpression: nodes += count_Expression(stmt[0]->expr); break;
+            case GBlock: nodes += count_Block(stmt[0]->block); break;
+            case GIf:
+                nodes += count_Expression(stmt[0]->if_stmt->cond) + count_Block(stmt[0]->if_stmt->then_block) +
+                         count_Block(stmt[0]->if_stmt->else_block);
+                break;
+            case GWhile:
+                nodes += count_Expression(stmt[0]->while_stmt->cond) + count_Block(stmt[0]->while_stmt->block);
+                break;
+            default: break;
+        }
+    }
+    return nodes;
+}
+
+struct Options {
+    int json;
+    FILE *output;
+    int size;
+    int repeat;
+    const char *filter;
+};
+
+static int by_value(const void *a, const void *b) {
+    const double x = *(const double *) a;
+    const double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/// one result line: the median and the best of the repeated timings, as work / second
+static void report_result(const struct Options *options, const char *name, const char *unit, const double work,
+                          double *seconds) {
+    qsort(seconds, options->repeat, sizeof(double), by_value);
+    const double median = work / seconds[options->repeat / 2];
+    const double best = work / seconds[0];
+    if (options->json) {
+        fprintf(options->output, "{\"bench\": \"%s\", \"unit\": \"%s\", \"median\": %.6g, \"best\": %.6g, "
+                                 "\"work\": %.6g, \"repeat\": %d, \"number\": \"%s\"}\n",
+                name, unit, median, best, work, options->repeat, sizeof(Number) == sizeof(double) ? "double" : "long double");
+    } else {
+        fprintf(options->output, "%-20s %14.4g %-10s (best %.4g)\n", name, median, unit, best);
+    }
+}
+
+static int selected(const struct Options *options, const char *name) {
+    return options->filter == nullptr || strstr(name, options->filter) != nullptr;
+}
+
+static void bench_tokenize(const struct Options *options, struct WinzigCalc *calc, const char *source) {
+    double *seconds = malloc(sizeof(double) * options->repeat);
+    const size_t length = strlen(source);
+    for (int r = 0; r < options->repeat; r++) {
+        Ts_refresh(calc->tokens);
+        const double start = now();
+        tokenize_n(calc->tokens, source, length);
+        seconds[r] = now() - start;
+    }
+    report_result(options, "tokenize", "MB/s", length / 1e6, seconds);
+    free(seconds);
+}
+
+static void bench_parse(const struct Options *options, struct WinzigCalc *calc, const char *source) {
+    double *seconds = malloc(sizeof(double) * options->repeat);
+    Ts_refresh(calc->tokens);
+    tokenize(calc->tokens, source);
+    int nodes = 0;
+    for (int r = 0; r < options->repeat; r++) {
+        calc->tokens->index = 0;
+        Parser_refresh(calc->parser);
+        const double start = now();
+        parse_file(calc->parser, calc->tokens);
+        seconds[r] = now() - start;
+        if (calc->parser->error != Success) {
+            fprintf(stderr, "parse_file failed: %s\n", calc->parser->message);
+            exit(1);
+        }
+        nodes = count_Block(calc->parser->result_block);
+    }
+    report_result(options, "parse", "nodes/s", nodes, seconds);
+    free(seconds);
+}
+
+/// the front end on source, for the interpret benchmarks
+static void prepare(struct WinzigCalc *calc, const char *source) {
+    Ts_refresh(calc->tokens);
+    tokenize(calc->tokens, source);
+    Parser_refresh(calc->parser);
+    parse_file(calc->parser, calc->tokens);
+    resolve_file(calc->parser, calc->interpreter->symbols);
+    if (calc->tokens->error != Success || calc->parser->error != Success) {
+        fprintf(stderr, "cannot prepare the script: %s\n", calc->parser->message);
+        exit(1);
+    }
+    optimize_file(calc->parser, calc->interpreter->symbols);
+    Interpreter_reserve(calc->interpreter);
+}
+
+/// interpret_Block (the walker) and interpret_file (compile and run on the vm) on one workload
+static void bench_interpret(const struct Options *options, const char *kind) {
+    char name[64];
+    char *source = generate(kind, options->size);
+    double *seconds = malloc(sizeof(double) * options->repeat);
+    for (int vm = 0; vm < 2; vm++) {
+        snprintf(name, sizeof(name), "%s_%s", vm ? "vm" : "walk", kind);
+        if (!selected(options, name)) {
+            continue;
+        }
+        struct WinzigCalc *calc = WinzigCalc_create();
+        calc->interpreter->mode = vm ? ModeBytecode : ModeTreeWalk;
+        prepare(calc, source);
+        for (int r = 0; r < options->repeat; r++) {
+            Interpreter_refresh(calc->interpreter);
+            const double start = now();
+            if (vm) {
+                interpret_file(calc->interpreter, calc->parser->result_block);
+            } else {
+                interpret_Block(calc->interpreter, calc->parser->result_block);
+            }
+            seconds[r] = now() - start;
+            if (vm && calc->interpreter->error != Success) {
+                fprintf(stderr, "%s failed: %s\n", name, calc->interpreter->message);
+                exit(1);
+            }
+        }
+        report_result(options, name, "iter/s", options->size, seconds);
+        WinzigCalc_delete(calc);
+    }
+    free(seconds);
+    free(source);
+}
+
+/// winzig_code on a small formula script, every call goes through the whole pipeline
+static void bench_latency(const struct Options *options) {
+    if (!selected(options, "winzig_code")) {
+        return;
+    }
+    const int calls = 2000;
+    char *source = generate("formula", 40);
+    struct WinzigCalc *calc = WinzigCalc_create();
+    calc->print_ast = 0;
+    double *seconds = malloc(sizeof(double) * options->repeat);
+    for (int r = 0; r < options->repeat; r++) {
+        const double start = now();
+        for (int i = 0; i < calls; i++) {
+            winzig_code(calc, source);
+        }
+        seconds[r] = (now() - start) / calls;
+    }
+    // latency is time / call, reported as calls / second like the rest
+    report_result(options, "winzig_code", "calls/s", 1, seconds);
+    free(seconds);
+    WinzigCalc_delete(calc);
+    free(source);
+}
+
+int main(int argc, char *argv[]) {
+    struct Options options = {0, stdout, 200000, 5, nullptr};
+    unsigned long long seed = 88172645463325252ULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            options.json = 1;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            options.output = fopen(argv[++i], "w");
+            if (!options.output) {
+                fprintf(stderr, "cannot open %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            options.size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            options.repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 10) * 2 + 1;
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (strcmp(argv[i], "--generate") == 0 && i + 2 < argc) {
+            state = seed;
+            char *script = generate(argv[i + 1], atoi(argv[i + 2]));
+            if (!script) {
+                fprintf(stderr, "unknown script kind %s\n", argv[i + 1]);
+                return 1;
+            }
+            fputs(script, stdout);
+            free(script);
+            return 0;
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (options.size < 1 || options.repeat < 1) {
+        fprintf(stderr, "--size and --repeat must be positive\n");
+        return 1;
+    }
+
+    state = seed;
+    char *mixed = generate("mixed", options.size / 20 > 0 ? options.size / 20 : 1);
+    struct WinzigCalc *calc = WinzigCalc_create();
+    if (selected(&options, "tokenize")) {
+        bench_tokenize(&options, calc, mixed);
+    }
+    if (selected(&options, "parse")) {
+        bench_parse(&options, calc, mixed);
+    }
+    WinzigCalc_delete(calc);
+    free(mixed);
+
+    bench_interpret(&options, "loop");
+    bench_interpret(&options, "builtin");
+    bench_interpret(&options, "assign");
+    bench_latency(&options);
+    if (options.output != stdout) {
+        fclose(options.output);
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+# include <stdlib.h>
+# include <string.h>
+# include "base.h"
+# include "compiler.h"
+# include "cache.h"
+
+// Program cache
+// a chained hash table for lookup plus a doubly linked list in use order for eviction, both O(1)
+
+/// 64 bit hash of the source, 8 bytes per step with a multiply-xorshift mix
+unsigned long long source_hash(const char *source, const size_t length) {
+    unsigned long long hash = 0x243f6a8885a308d3ULL ^ length;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        unsigned long long word;
+        memcpy(&word, source + i, 8);
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 32;
+    }
+    unsigned long long tail = 0;
+    memcpy(&tail, source + i, length - i);
+    hash = (hash ^ tail) * 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 29;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    return hash ^ hash >> 32;
+}
+
+static struct CacheEntry **alloc_buckets(const unsigned int capacity) {
+    struct CacheEntry **buckets = calloc(capacity, sizeof(struct CacheEntry *));
+    if (!buckets) {
+        panic("out of memory!", 1)
+    }
+    return buckets;
+}
+
+/// ProgramCache.constructor
+struct ProgramCache *ProgramCache_create(const size_t max_bytes) {
+    struct ProgramCache *cache = malloc(sizeof(struct ProgramCache));
+    if (!cache) {
+        panic("out of memory!", 1)
+    }
+    cache->capacity = 64;
+    cache->buckets = alloc_buckets(cache->capacity);
+    cache->count = 0;
+    cache->head = nullptr;
+    cache->tail = nullptr;
+    cache->bytes = 0;
+    cache->max_bytes = max_bytes;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->evictions = 0;
+    return cache;
+}
+
+static void CacheEntry_delete(struct CacheEntry *entry) {
+    Program_delete(entry->program);
+    free(entry->source);
+    free(entry);
+}
+
+/// ProgramCache.clear: drop every entry, the counters are kept
+void ProgramCache_clear(struct ProgramCache *cache) {
+    struct CacheEntry *entry = cache->head;
+    while (entry) {
+        struct CacheEntry *next = entry->next;
+        CacheEntry_delete(entry);
+        entry = next;
+    }
+    memset(cache->buckets, 0, sizeof(struct CacheEntry *) * cache->capacity);
+    cache->count = 0;
+    cache->head = nullptr;
+    cache->tail = nullptr;
+    cache->bytes = 0;
+}
+
+/// ProgramCache.destructor
+void ProgramCache_delete(struct ProgramCache *cache) {
+    ProgramCache_clear(cache);
+    free(cache->buckets);
+    free(cache);
+}
+
+static void lru_unlink(struct ProgramCache *cache, struct CacheEntry *entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+}
+
+static void lru_push_front(struct ProgramCache *cache, struct CacheEntry *entry) {
+    entry->prev = nullptr;
+    entry->next = cache->head;
+    if (cache->head) {
+        cache->head->prev = entry;
+    } else {
+        cache->tail = entry;
+    }
+    cache->head = entry;
+}
+
+/// take entry out of the table and the list and free it
+static void ProgramCache_remove(struct ProgramCache *cache, struct CacheEntry *entry) {
+    struct CacheEntry **link = &cache->buckets[entry->hash & (cache->capacity - 1)];
+    while (*link != entry) {
+        link = &(*link)->chain;
+    }
+    *link = entry->chain;
+    lru_unlink(cache, entry);
+    cache->bytes -= entry->bytes;
+    cache->count--;
+    CacheEntry_delete(entry);
+}
+
+/// double the buckets, entries keep their place in the lru list
+static void ProgramCache_grow(struct ProgramCache *cache) {
+    const unsigned int capacity = cache->capacity * 2;
+    struct CacheEntry **buckets = alloc_buckets(capacity);
+    for (struct CacheEntry *entry = cache->head; entry; entry = entry->next) {
+        struct CacheEntry **bucket = &buckets[entry->hash & (capacity - 1)];
+        entry->chain = *bucket;
+        *bucket = entry;
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->capacity = capacity;
+}
+
+/**
+ * Find the program compiled from source
+ *
+ * @param hash source_hash(source, length)
+ * @return the program, now the most recently used, or nullptr
+ */
+const struct Program *ProgramCache_find(struct ProgramCache *cache, const char *source, const size_t length,
+                                        const unsigned long long hash) {
+    for (struct CacheEntry *entry = cache->buckets[hash & (cache->capacity - 1)]; entry; entry = entry->chain) {
+        if (entry->hash == hash && entry->length == length && memcmp(entry->source, source, length) == 0) {
+            if (cache->head != entry) {
+                lru_unlink(cache, entry);
+                lru_push_front(cache, entry);
+            }
+            cache->hits++;
+            return entry->program;
+        }
+    }
+    cache->misses++;
+    return nullptr;
+}
+
+static size_t Program_bytes(const struct Program *program) {
+    return sizeof(struct Program) + sizeof(struct Instr) * program->size + sizeof(Number) * program->const_size +
+           sizeof(*program->funcs) * program->func_size;
+}
+
+/**
+ * Keep a compiled program, evicting the least recently used ones to stay in max_bytes
+ *
+ * The cache owns program from now on. A program that doesn't fit even alone is deleted right away.
+ */
+void ProgramCache_insert(struct ProgramCache *cache, const char *source, const size_t length,
+                         const unsigned long long hash, struct Program *program) {
+    const size_t bytes = sizeof(struct CacheEntry) + length + Program_bytes(program);
+    if (bytes > cache->max_bytes) {
+        Program_delete(program);
+        return;
+    }
+    while (cache->bytes + bytes > cache->max_bytes) {
+        ProgramCache_remove(cache, cache->tail);
+        cache->evictions++;
+    }
+    if ((unsigned int) cache->count + 1 > cache->capacity) {
+        ProgramCache_grow(cache);
+    }
+
+    struct CacheEntry *entry = malloc(sizeof(struct CacheEntry));
+    char *copy = malloc(length > 0 ? length : 1);
+    if (!entry || !copy) {
+        panic("out of memory!", 1)
+    }
+    memcpy(copy, source, length);
+    entry->hash = hash;
+    entry->source = copy;
+    entry->length = length;
+    entry->program = program;
+    entry->bytes = bytes;
+    struct CacheEntry **bucket = &cache->buckets[hash & (cache->capacity - 1)];
+    entry->chain = *bucket;
+    *bucket = entry;
+    lru_push_front(cache, entry);
+    cache->bytes += bytes;
+    cache->count++;
+}
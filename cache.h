@@ -0,0 +1,55 @@
+# pragma once
+# ifndef CACHE_H
+# define CACHE_H
+# include <stddef.h>
+# include "base.h"
+
+struct Program;
+
+/// one cached script, in the bucket chain of its hash and in the lru list
+struct CacheEntry {
+    unsigned long long hash;
+    char *source; /// a copy, compared on lookup so a hash collision can never run the wrong program
+    size_t length;
+    struct Program *program;
+    size_t bytes; /// memory held by the entry, counted against max_bytes
+    struct CacheEntry *chain; /// next entry in the same bucket
+    struct CacheEntry *prev; /// lru list, head is the most recently used
+    struct CacheEntry *next;
+};
+
+///
+/// Compiled programs by source text, least recently used entries are dropped first.
+///
+/// A program refers to variable slots, so a cache belongs to one interpreter (one symbol table)
+/// and must not be shared between WinzigCalc instances.
+///
+struct ProgramCache {
+    struct CacheEntry **buckets;
+    unsigned int capacity; /// power of 2
+    int count;
+    struct CacheEntry *head;
+    struct CacheEntry *tail;
+    size_t bytes;
+    size_t max_bytes; /// entries are evicted until bytes fits again
+
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+};
+
+unsigned long long source_hash(const char *source, size_t length);
+
+struct ProgramCache *ProgramCache_create(size_t max_bytes);
+
+void ProgramCache_delete(struct ProgramCache *cache);
+
+void ProgramCache_clear(struct ProgramCache *cache);
+
+const struct Program *ProgramCache_find(struct ProgramCache *cache, const char *source, size_t length,
+                                        unsigned long long hash); // counts a hit or a miss
+
+void ProgramCache_insert(struct ProgramCache *cache, const char *source, size_t length, unsigned long long hash,
+                         struct Program *program); // takes the program
+
+# endif //CACHE_H
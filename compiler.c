@@ -0,0 +1,306 @@
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include "base.h"
+# include "report.h"
+# include "parser.h"
+# include "interpreter.h"
+# include "compiler.h"
+
+// Bytecode compiler
+// flattens the Block from parse_file into a linear Program, so the vm does not chase pointers through the tree
+
+/// Program.constructor
+struct Program *Program_create() {
+    struct Program *program = malloc(sizeof(struct Program));
+    if (!program) {
+        panic("out of memory!", 1)
+    }
+    program->code = nullptr;
+    program->count = 0;
+    program->size = 0;
+    program->consts = nullptr;
+    program->const_count = 0;
+    program->const_size = 0;
+    program->funcs = nullptr;
+    program->func_count = 0;
+    program->func_size = 0;
+    program->depth = 0;
+    program->max_depth = 0;
+    program->error = Running;
+    program->message = nullptr;
+    return program;
+}
+
+/// Program.refresh: drop the code but keep the memory for the next compile_file
+void Program_refresh(struct Program *program) {
+    program->count = 0;
+    program->const_count = 0;
+    program->func_count = 0;
+    program->depth = 0;
+    program->max_depth = 0;
+    program->error = Running;
+    program->message = nullptr;
+}
+
+/// Program.destructor
+void Program_delete(struct Program *program) {
+    free(program->code);
+    free(program->consts);
+    free(program->funcs);
+    free(program);
+}
+
+/// grow an array member of Program, the same way Ts_push does
+# define ensure_capacity(ptr, count, size) \
+    if ((count) >= (size)) { \
+        (size) = (size) ? (size) * 2 : 64; \
+        void *new_memory = realloc(ptr, sizeof(*(ptr)) * (size)); \
+        if (!new_memory) { \
+            panic("out of memory!", 1) \
+        } \
+        (ptr) = new_memory; \
+    }
+
+/// how many values an instruction pushes (positive) or pops (negative)
+int stack_effect(const enum ByteCode code) {
+    switch (code) {
+        case BcConst:
+        case BcLoad:
+        case BcLoadBelow:
+            return 1;
+        case BcAdd: case BcSub: case BcMul: case BcDiv: case BcPow: case BcAnd: case BcOr:
+        case BcLt: case BcLe: case BcGt: case BcGe: case BcEq: case BcNe:
+        case BcResult:
+        case BcAssign:
+        case BcJumpFalse:
+        case BcJumpNotPositive:
+        case BcJumpAnd: // counted as the fall through, the jump keeps one value like the rhs would push
+        case BcJumpOr:
+        case BcHoist:
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+/// append an instruction, return its index (for patching jumps)
+static int emit(struct Program *program, const enum ByteCode code, const int arg) {
+    program->depth += stack_effect(code);
+    if (program->depth > program->max_depth) {
+        program->max_depth = program->depth;
+    }
+
+    // peephole: merge with the previous instruction, saves a dispatch and a push.
+    // never crosses a jump target, BcConst as right operand and BcStore are always inside one expression
+    if (program->count > 0) {
+        struct Instr *last = &program->code[program->count - 1];
+        if (last->code == BcConst && code >= BcAdd && code <= BcNe) {
+            last->code = code + (BcAddK - BcAdd);
+            return program->count - 1;
+        }
+        if (last->code == BcStore && code == BcResult) {
+            last->code = BcAssign;
+            return program->count - 1;
+        }
+    }
+
+    ensure_capacity(program->code, program->count, program->size);
+    program->code[program->count].code = code;
+    program->code[program->count].arg = arg;
+    return program->count++;
+}
+
+static void patch(struct Program *program, const int at, const int target) {
+    program->code[at].arg = target;
+}
+
+static int add_const(struct Program *program, const Number value) {
+    ensure_capacity(program->consts, program->const_count, program->const_size);
+    program->consts[program->const_count] = value;
+    return program->const_count++;
+}
+
+static int add_func(struct Program *program, Number (*func)(struct Interpreter *, Number)) {
+    for (int i = 0; i < program->func_count; i++) {
+        if (program->funcs[i] == func) {
+            return i;
+        }
+    }
+    ensure_capacity(program->funcs, program->func_count, program->func_size);
+    program->funcs[program->func_count] = func;
+    return program->func_count++;
+}
+
+# undef ensure_capacity
+
+/// cheap to evaluate and without side effects, not worth a jump
+static int is_leaf(const struct Expression *expr) {
+    return expr->tag == GLiteral || expr->tag == GIdentifier;
+}
+
+/// map a binary operator to its instruction, BcHalt if it is not a plain binary operator
+static enum ByteCode binary_code(const enum Operator op) {
+    if (op >= OpAdd && op <= OpNe) {
+        return BcAdd + (op - OpAdd);
+    }
+    return BcHalt;
+}
+
+static void compile_Block(struct Program *program, struct Block *block);
+
+static void compile_Expression(struct Program *program, struct Expression *expr) {
+    switch (expr->tag) {
+        case GLiteral:
+            emit(program, BcConst, add_const(program, expr->literal->value));
+            return;
+        case GIdentifier:
+            emit(program, BcLoad, expr->identifier->slot);
+            return;
+        case GBuiltin:
+            if (expr->builtin->func == nullptr) {
+                report(program, SyntaxError, "unknown function");
+                return;
+            }
+            compile_Expression(program, expr->builtin->expr);
+            if (is_intrinsic(expr->builtin->id)) {
+                emit(program, BcSqrt + (expr->builtin->id - BuiltinSqrt), 0);
+            } else {
+                emit(program, BcCall, add_func(program, expr->builtin->func));
+            }
+            return;
+        case GExpr2:
+            break;
+        default:
+            report(program, SyntaxError, "Unknown expression tag");
+            return;
+    }
+
+    const struct Expr2 *expr2 = expr->expr2;
+    if ((expr2->op == OpAnd || expr2->op == OpOr) && !is_leaf(expr2->rhs)) {
+        // short-circuit: the rhs only runs when the lhs does not decide the result
+        compile_Expression(program, expr2->lhs);
+        const int to_end = emit(program, expr2->op == OpAnd ? BcJumpAnd : BcJumpOr, 0);
+        compile_Expression(program, expr2->rhs);
+        emit(program, BcTruth, 0);
+        patch(program, to_end, program->count);
+        return;
+    }
+    const enum ByteCode code = binary_code(expr2->op);
+    if (code != BcHalt) {
+        compile_Expression(program, expr2->lhs);
+        compile_Expression(program, expr2->rhs);
+        emit(program, code, 0);
+        return;
+    }
+
+    if (!is_assign_op(expr2->op)) {
+        report(program, SyntaxError, "Unknown operator");
+        return;
+    }
+    if (expr2->lhs->tag != GIdentifier) {
+        report(program, SyntaxError, "can only assign to a variable");
+        return;
+    }
+    const int slot = expr2->lhs->identifier->slot;
+    compile_Expression(program, expr2->rhs);
+    if (expr2->op != OpAssign) {
+        const enum ByteCode calc_code = binary_code(assign_base(expr2->op));
+        // the value is evaluated before the variable is read, same as interpret_Expression
+        emit(program, BcLoadBelow, slot);
+        emit(program, calc_code, 0);
+    }
+    emit(program, BcStore, slot);
+}
+
+static void compile_Statement(struct Program *program, struct Statement *stmt) {
+    if (stmt->tag == GExpression) {
+        const struct Expression *expr = stmt->expr;
+        if (expr->tag == GExpr2 && expr->expr2->op == OpAssign && expr->expr2->lhs->tag == GIdentifier &&
+            expr->expr2->lhs->identifier->hoisted) {
+            // not the value of the block, it is never the last statement
+            compile_Expression(program, expr->expr2->rhs);
+            emit(program, BcHoist, expr->expr2->lhs->identifier->slot);
+            return;
+        }
+        compile_Expression(program, stmt->expr);
+        emit(program, BcResult, 0);
+        return;
+    }
+    if (stmt->tag == GIf) {
+        compile_Expression(program, stmt->if_stmt->cond);
+        const int to_else = emit(program, BcJumpFalse, 0);
+        compile_Block(program, stmt->if_stmt->then_block);
+        const int to_end = emit(program, BcJump, 0);
+        patch(program, to_else, program->count);
+        compile_Block(program, stmt->if_stmt->else_block);
+        patch(program, to_end, program->count);
+        return;
+    }
+    if (stmt->tag == GWhile) {
+        const int top = program->count;
+        compile_Expression(program, stmt->while_stmt->cond);
+        const int to_end = emit(program, BcJumpNotPositive, 0);
+        compile_Block(program, stmt->while_stmt->block);
+        emit(program, BcJump, top);
+        patch(program, to_end, program->count);
+        emit(program, BcZero, 0);
+        return;
+    }
+    if (stmt->tag == GBlock) {
+        compile_Block(program, stmt->block);
+        return;
+    }
+    report(program, SyntaxError, "Unknown statement tag");
+}
+
+static void compile_Block(struct Program *program, struct Block *block) {
+    struct Statement **stmt = block->stmts;
+    if (stmt[0]->tag == GNull) {
+        emit(program, BcZero, 0); // an empty block evaluates to 0
+        return;
+    }
+    while (stmt[0]->tag != GNull && program->error == Running) {
+        compile_Statement(program, *stmt);
+        stmt++;
+    }
+}
+
+/**
+ * Compile a parsed file into bytecode
+ *
+ * @param program the program to fill, should be empty (created or refreshed)
+ * @param block the result_block of parse_file
+ */
+void compile_file(struct Program *program, struct Block *block) {
+    compile_Block(program, block);
+    emit(program, BcHalt, 0);
+    if (program->error == Running) {
+        program->error = Success;
+    }
+}
+
+void print_Program(const struct Program *program) {
+    static const char *names[] = {
+        "halt", "const", "load", "load_below", "store",
+        "add", "sub", "mul", "div", "pow", "and", "or",
+        "lt", "le", "gt", "ge", "eq", "ne",
+        "add_k", "sub_k", "mul_k", "div_k", "pow_k", "and_k", "or_k",
+        "lt_k", "le_k", "gt_k", "ge_k", "eq_k", "ne_k",
+        "call", "sqrt", "abs", "sin", "cos", "exp", "log", "floor", "result", "assign", "zero", "jump", "jump_false", "jump_not_positive",
+        "jump_and", "jump_or", "truth", "hoist",
+    };
+    for (int i = 0; i < program->count; i++) {
+        const struct Instr instr = program->code[i];
+        printf("%4d %-18s", i, names[instr.code]);
+        if (instr.code == BcConst || (instr.code >= BcAddK && instr.code <= BcNeK)) {
+            printf(NUMBER_FORMAT, program->consts[instr.arg]);
+        } else if (instr.code == BcLoad || instr.code == BcLoadBelow || instr.code == BcStore || instr.code == BcAssign ||
+                   instr.code == BcCall || instr.code == BcJump ||
+                   instr.code == BcJumpFalse || instr.code == BcJumpNotPositive ||
+                   instr.code == BcJumpAnd || instr.code == BcJumpOr || instr.code == BcHoist) {
+            printf("%d", instr.arg);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,79 @@
+# pragma once
+# ifndef COMPILER_H
+# define COMPILER_H
+# include "base.h"
+# include "number.h"
+
+struct Block;
+struct Interpreter;
+
+///
+/// Bytecode for the stack vm in vm.c.
+///
+/// Every instruction is a fixed size (code, arg) pair, jumps use absolute instruction indexes.
+/// The operand stack only holds Number.
+///
+enum ByteCode {
+    BcHalt, /// stop the program
+    BcConst, /// push consts[arg]
+    BcLoad, /// push variables[arg], arg is the slot from resolve_file
+    BcLoadBelow, /// insert variables[arg] below the top, for `a op= b` (b is evaluated first)
+    BcStore, /// variables[arg] = top, the value stays on the stack
+    BcAdd, BcSub, BcMul, BcDiv, BcPow, BcAnd, BcOr, /// pop b, pop a, push a op b
+    BcLt, BcLe, BcGt, BcGe, BcEq, BcNe,
+    BcAddK, BcSubK, BcMulK, BcDivK, BcPowK, BcAndK, BcOrK, /// top = top op consts[arg], same order as above
+    BcLtK, BcLeK, BcGtK, BcGeK, BcEqK, BcNeK,
+    BcCall, /// top = funcs[arg](interpreter, top)
+    BcSqrt, BcAbs, BcSin, BcCos, BcExp, BcLog, BcFloor, /// top = f(top), the intrinsics in BuiltinId order
+    BcResult, /// pop into the result register, ends an expression statement
+    BcAssign, /// BcStore then BcResult, the usual `a = b;` statement
+    BcZero, /// result register = 0, for while and empty blocks
+    BcJump, /// pc = arg
+    BcJumpFalse, /// pop, pc = arg if value < eps (if)
+    BcJumpNotPositive, /// pop, pc = arg if value <= eps (while)
+    BcJumpAnd, /// top false: top = 0 and pc = arg, else pop (short-circuit &)
+    BcJumpOr, /// top true: top = 1 and pc = arg, else pop (short-circuit |)
+    BcTruth, /// top = truthy(top), the right operand of a short-circuit & or |
+    BcHoist, /// pop into variables[arg] without the nan check, a loop-invariant temporary (see optimizer.h)
+    BcCount, /// not an instruction, the number of them
+};
+
+struct Instr {
+    enum ByteCode code;
+    int arg;
+};
+
+/// A compiled Block, the AST is not needed anymore after compile_file
+struct Program {
+    struct Instr *code;
+    int count;
+    int size;
+
+    Number *consts;
+    int const_count;
+    int const_size;
+
+    Number (**funcs)(struct Interpreter *, Number);
+    int func_count;
+    int func_size;
+
+    int depth; /// stack depth while compiling
+    int max_depth; /// deepest operand stack the program needs
+    enum Error error;
+    const char *message; /// text of the last error, see report.h
+};
+
+struct Program *Program_create();
+
+void Program_refresh(struct Program *program);
+
+void Program_delete(struct Program *program);
+
+
+int stack_effect(enum ByteCode code);
+
+void compile_file(struct Program *program, struct Block *block);
+
+void print_Program(const struct Program *program);
+
+# endif //COMPILER_H
@@ -0,0 +1,221 @@
+# include <ctype.h>
+# include <errno.h>
+# include <fcntl.h>
+# include <stdlib.h>
+# include <string.h>
+# include <unistd.h>
+# include "base.h"
+# include "input.h"
+
+// Input buffer
+// input() takes the next word straight out of a large block, no stdio and no copy per number
+
+/// Input.constructor, reads stdin
+struct Input *Input_create(const size_t size) {
+    struct Input *input = malloc(sizeof(struct Input));
+    if (!input) {
+        panic("out of memory!", 1)
+    }
+    input->size = size > 0 ? size : 1;
+    input->buffer = malloc(input->size + 1);
+    if (!input->buffer) {
+        panic("out of memory!", 1)
+    }
+    input->fd = -1;
+    input->owned = 0;
+    Input_set_fd(input, STDIN_FILENO);
+    return input;
+}
+
+static void Input_close(struct Input *input) {
+    if (input->owned) {
+        close(input->fd);
+    }
+    input->owned = 0;
+}
+
+/// Input.destructor
+void Input_delete(struct Input *input) {
+    Input_close(input);
+    free(input->buffer);
+    free(input);
+}
+
+/// read from fd, interactive when it is a terminal; unread bytes of the previous source are dropped
+void Input_set_fd(struct Input *input, const int fd) {
+    Input_close(input);
+    input->data = input->buffer;
+    input->position = 0;
+    input->filled = 0;
+    input->fd = fd;
+    input->eof = 0;
+    input->interactive = isatty(fd);
+}
+
+int Input_open(struct Input *input, const char *filename) {
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    Input_set_fd(input, fd);
+    input->owned = 1;
+    return 1;
+}
+
+/// read the numbers in data[0, length), not interactive
+void Input_set_memory(struct Input *input, const char *data, const size_t length) {
+    Input_close(input);
+    input->data = data;
+    input->position = 0;
+    input->filled = length;
+    input->fd = -1;
+    input->eof = 1;
+    input->interactive = 0;
+}
+
+/// keep the unread bytes and read the next block after them, 0 at the end of the input
+static int Input_fill(struct Input *input) {
+    if (input->eof) {
+        return 0;
+    }
+    const size_t left = input->filled - input->position;
+    memmove(input->buffer, input->buffer + input->position, left);
+    input->position = 0;
+    input->filled = left;
+    if (left == input->size) {
+        // one word fills the whole buffer
+        input->size *= 2;
+        void *new_memory = realloc(input->buffer, input->size + 1);
+        if (!new_memory) {
+            panic("out of memory!", 1)
+        }
+        input->buffer = new_memory;
+        input->data = new_memory;
+    }
+    ssize_t n;
+    do {
+        n = read(input->fd, input->buffer + left, input->size - left);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        input->eof = 1;
+        return 0;
+    }
+    input->filled += n;
+    return 1;
+}
+
+/// next whitespace separated word, nullptr at the end of the input
+static const char *Input_word(struct Input *input, size_t *length) {
+    while (1) {
+        while (input->position < input->filled && isspace((unsigned char) input->data[input->position])) {
+            input->position++;
+        }
+        if (input->position == input->filled) {
+            if (!Input_fill(input)) {
+                return nullptr;
+            }
+            continue;
+        }
+        size_t end = input->position;
+        while (end < input->filled && !isspace((unsigned char) input->data[end])) {
+            end++;
+        }
+        if (end == input->filled && !input->eof) {
+            Input_fill(input); // the word may go on in the next block, it moves to the front
+            continue;
+        }
+        const char *word = input->data + input->position;
+        *length = end - input->position;
+        input->position = end;
+        return word;
+    }
+}
+
+/**
+ * Read the next line, of any length, for the repl; input() reads from the same buffer, so a number typed
+ * for a running line is never swallowed as code or the other way round
+ *
+ * @param length set to its length without the '\n'
+ * @return the line, valid until the next read, not '\0' terminated; nullptr at the end of the input
+ */
+const char *input_line(struct Input *input, size_t *length) {
+    size_t end = input->position;
+    while (1) {
+        const char *newline = memchr(input->data + end, '\n', input->filled - end);
+        if (newline) {
+            end = newline - input->data;
+            break;
+        }
+        end = input->filled;
+        if (input->eof) {
+            if (input->position == input->filled) {
+                return nullptr;
+            }
+            break; // the last line has no '\n'
+        }
+        const size_t scanned = end - input->position;
+        Input_fill(input); // moves the unread bytes to the front
+        end = input->position + scanned;
+    }
+    const char *line = input->data + input->position;
+    *length = end - input->position;
+    input->position = end < input->filled ? end + 1 : end;
+    return line;
+}
+
+/// a word of up to 18 digits with an optional sign, exact without strtold; 0 for anything else
+static int parse_integer(const char *text, const size_t size, Number *x) {
+    size_t i = text[0] == '-' || text[0] == '+';
+    if (size == i || size - i > 18) {
+        return 0;
+    }
+    long long value = 0;
+    for (size_t k = i; k < size; k++) {
+        if (text[k] < '0' || text[k] > '9') {
+            return 0;
+        }
+        value = value * 10 + (text[k] - '0');
+    }
+    if (text[0] == '-' && value == 0) {
+        return 0; // -0, strtold keeps the sign
+    }
+    *x = (Number) (text[0] == '-' ? -value : value);
+    return 1;
+}
+
+/**
+ * Read the next number
+ *
+ * @param word set to the word that was read, for the message on InputBad (not '\0' terminated)
+ * @param length its length
+ */
+enum InputResult input_number(struct Input *input, Number *x, const char **word, int *length) {
+    size_t size;
+    const char *text = Input_word(input, &size);
+    if (!text || text[0] == 'Q' || text[0] == 'q') {
+        return InputEnd;
+    }
+    *word = text;
+    *length = (int) size;
+    if (parse_integer(text, size, x)) {
+        return InputNumber;
+    }
+    char *end = nullptr;
+    if (text + size < input->data + input->filled) {
+        *x = number_parse(text, &end); // whitespace follows, strtold stops there
+    } else if (input->fd >= 0) {
+        input->buffer[input->filled] = '\0'; // the spare byte
+        *x = number_parse(text, &end);
+    } else {
+        // the last word of the caller's memory, nothing may be read after it
+        char copy[256];
+        if (size >= sizeof(copy)) {
+            return InputBad;
+        }
+        memcpy(copy, text, size);
+        copy[size] = '\0';
+        *x = number_parse(copy, &end);
+        end = (char *) text + (end - copy);
+    }
+    return end == text + size ? InputNumber : InputBad;
+}
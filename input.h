@@ -0,0 +1,48 @@
+# pragma once
+# ifndef INPUT_H
+# define INPUT_H
+# include <stddef.h>
+# include "base.h"
+# include "number.h"
+
+# define INPUT_BUFFER_SIZE 65536
+
+///
+/// Buffered source of input().
+///
+/// Reads a file descriptor in large blocks, or walks a memory buffer of the caller without copying it.
+/// Numbers are parsed in place, separated by any whitespace. One per interpreter, never shared.
+///
+struct Input {
+    char *buffer; /// read buffer for a file descriptor, one spare byte at the end for a '\0'
+    size_t size;
+    const char *data; /// buffer or the caller's memory
+    size_t position; /// next unread byte of data
+    size_t filled; /// bytes of data that are valid
+    int fd; /// -1 for memory
+    int owned; /// fd was opened by Input_open and is closed with the Input
+    int eof;
+    int interactive; /// print a prompt and read again on a bad number, else it is an error, see Input_set_fd
+};
+
+enum InputResult {
+    InputNumber, /// a number was read
+    InputEnd, /// the end of the input or q / Q
+    InputBad, /// a word that is not a number
+};
+
+struct Input *Input_create(size_t size);
+
+void Input_delete(struct Input *input);
+
+void Input_set_fd(struct Input *input, int fd);
+
+int Input_open(struct Input *input, const char *filename); // 0 if the file can't be opened
+
+void Input_set_memory(struct Input *input, const char *data, size_t length); // data must outlive its use
+
+enum InputResult input_number(struct Input *input, Number *x, const char **word, int *length);
+
+const char *input_line(struct Input *input, size_t *length);
+
+# endif //INPUT_H
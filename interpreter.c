@@ -2,8 +2,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include "base.h"
+#include "report.h"
 #include "parser.h"
 #include "interpreter.h"
+#include "compiler.h"
+#include "symbols.h"
+#include "output.h"
+#include "input.h"
+#include "jit.h"
+#include "profile.h"
 
 // A Expression Calculator
 // can eval +-*/(), math function call, variable, assignment, simple loop, if-else, function definition and call
@@ -24,120 +31,209 @@
 * if, else, while, return
 */
 
-int string_hash(const char *str) {
-    int hash = 5381;
-    while (*str) {
-        hash = (hash * 31 + *str) % VAR_HASH_SIZE;
-        str++;
-    }
-    return hash;
-}
-
-long double calc(struct Interpreter *interpreter, long double a, long double b, char *op) {
-    if (op[1] != '\0') {
-        switch (*op) {
-            case '>': return a >= b;
-            case '<': return a <= b;
-            case '=': return a == b;
-            case '!': return a != b;
-            default:
-                report_error(interpreter->error, RuntimeError, "Unknown operator");
-                return 0; // should not reach here
-        }
-    }
-    switch (*op) {
-        case '+': return a + b;
-        case '-': return a - b;
-        case '*': return a * b;
-        case '/': return a / b;
-        case '%': return fmodl(a, b);
-        case '^': return powl(a, b);
-        case '&': return (long long) a & (long long) b;
-        case '|': return (long long) a | (long long) b;
-        case '>': return a > b;
-        case '<': return a < b;
+Number calc(struct Interpreter *interpreter, const Number a, const Number b, const enum Operator op) {
+    switch (op) {
+        case OpAdd: return a + b;
+        case OpSub: return a - b;
+        case OpMul: return a * b;
+        case OpDiv: return a / b;
+        case OpPow: return NUM(pow)(a, b);
+        case OpAnd: return truthy(a) && truthy(b);
+        case OpOr: return truthy(a) || truthy(b);
+        case OpLt: return a < b;
+        case OpLe: return a <= b;
+        case OpGt: return a > b;
+        case OpGe: return a >= b;
+        case OpEq: return a == b;
+        case OpNe: return a != b;
         default:
-            report_error(interpreter->error, RuntimeError, "Unknown operator");
-            return 0;
-        // should not reach here
+            report(interpreter, RuntimeError, "Unknown operator");
+            return 0; // should not reach here
     }
 }
 
 
 struct Interpreter *Interpreter_create() {
     struct Interpreter *interpreter = malloc(sizeof(struct Interpreter));
-    memset(interpreter->variables, -1, sizeof(interpreter->variables));
+    interpreter->symbols = Symbols_create();
+    interpreter->variables = nullptr;
+    interpreter->variable_count = 0;
     interpreter->error = 0;
+    interpreter->message = nullptr;
+    interpreter->mode = ModeBytecode;
+    interpreter->program = Program_create();
+    interpreter->stack = nullptr;
+    interpreter->stack_size = 0;
+    interpreter->random_state = RANDOM_SEED;
+    interpreter->output = Output_create(OUTPUT_BUFFER_SIZE);
+    interpreter->input = Input_create(INPUT_BUFFER_SIZE);
+    interpreter->jit = Jit_create();
+    interpreter->profile = nullptr;
     return interpreter;
 }
 
-long double Interpreter_get(struct Interpreter *interpreter, const char *name) {
-    long double value = interpreter->variables[string_hash(name)];
-    if (isnanl(value)) {
-        report_error(interpreter->error, MathError, "found an nan, this maybe undef variable or illegal operation");
+/// grow the variables to the symbol table, new slots are filled with nan (undefined)
+void Interpreter_reserve(struct Interpreter *interpreter) {
+    const int count = interpreter->symbols->count;
+    if (count <= interpreter->variable_count) {
+        return;
+    }
+    void *new_memory = realloc(interpreter->variables, sizeof(Number) * count);
+    if (!new_memory) {
+        panic("out of memory!", 1)
+    }
+    interpreter->variables = new_memory;
+    memset(interpreter->variables + interpreter->variable_count, -1,
+           sizeof(Number) * (count - interpreter->variable_count));
+    interpreter->variable_count = count;
+}
+
+/// read a variable, resolve_file already made sure it is assigned before
+Number Interpreter_get(const struct Interpreter *interpreter, const int slot) {
+    return interpreter->variables[slot];
+}
+
+/// store a variable; a nan is stored and stops the run, nothing is stored once the run stopped
+void Interpreter_set(struct Interpreter *interpreter, const int slot, const Number value) {
+    if (interpreter->error != Running) {
+        return;
+    }
+    interpreter->variables[slot] = value;
+    if (isnan(value)) {
+        report(interpreter, MathError, NAN_MESSAGE);
     }
-    return interpreter->variables[string_hash(name)];
 }
 
-void Interpreter_set(struct Interpreter *interpreter, const char *name, const long double value) {
-    if (isnanl(value)) {
-        report_error(interpreter->error, MathError, "found an nan from calculation, maybe you operated illegally");
+/// a builtin call under --profile, timed with its argument
+static Number profile_Builtin(struct Interpreter *interpreter, const struct Builtin *builtin) {
+    const long long start = profile_now();
+    const Number value = interpret_Expression(interpreter, builtin->expr);
+    if (interpreter->error != Running) {
+        return 0;
     }
-    interpreter->variables[string_hash(name)] = value;
+    const Number rv = is_intrinsic(builtin->id) ? intrinsic_call(builtin->id, value)
+                                                : builtin->func(interpreter, value);
+    profile_builtin(interpreter->profile, builtin->id, profile_now() - start);
+    return rv;
 }
 
-long double interpret_Expression(struct Interpreter *interpreter, struct Expression *expr) {
+Number interpret_Expression(struct Interpreter *interpreter, struct Expression *expr) {
     if (expr->tag == GError) {
-        report_error(interpreter->error, RuntimeError, "Uncaught error");
+        report(interpreter, RuntimeError, "Uncaught error");
         return 0;
     }
     if (expr->tag == GLiteral) {
         return expr->literal->value;
     }
     if (expr->tag == GIdentifier) {
-        return Interpreter_get(interpreter, expr->identifier->name); // the assignment should be done previously
+        return Interpreter_get(interpreter, expr->identifier->slot); // the assignment should be done previously
     }
     if (expr->tag == GBuiltin) {
-        const long double value = interpret_Expression(interpreter, expr->builtin->expr);
+        if (interpreter->profile) {
+            return profile_Builtin(interpreter, expr->builtin);
+        }
+        const Number value = interpret_Expression(interpreter, expr->builtin->expr);
+        if (is_intrinsic(expr->builtin->id)) {
+            return intrinsic_call(expr->builtin->id, value);
+        }
+        if (interpreter->error != Running) {
+            return 0; // the run stopped inside this statement, no more side effects, see interpret_Block
+        }
         return expr->builtin->func(interpreter, value);
     }
     if (expr->tag == GExpr2) {
         struct Expr2 *expr2 = expr->expr2;
-        if ((expr2->op[0] == '=' && expr2->op[1] == '\0') || (
-                expr2->op[1] == '=' && expr2->op[0] != '=' && expr2->op[0] != '<' && expr2->op[0] != '>')) {
+        if (is_assign_op(expr2->op)) {
             if (expr2->lhs->tag == GIdentifier) {
-                const long double value = interpret_Expression(interpreter, expr2->rhs);
-                if (expr2->op[1] == '=') {
+                const Number value = interpret_Expression(interpreter, expr2->rhs);
+                if (expr2->lhs->identifier->hoisted) {
+                    interpreter->variables[expr2->lhs->identifier->slot] = value; // see BcHoist
+                    return value;
+                }
+                if (expr2->op != OpAssign) {
                     // calc then assign
-                    char op[2] = {expr2->op[0], '\0'};
-                    long double before = Interpreter_get(interpreter, expr2->lhs->identifier->name);
-                    long double after = calc(interpreter, before, value, op);
-                    Interpreter_set(interpreter, expr2->lhs->identifier->name, after);
+                    Number before = Interpreter_get(interpreter, expr2->lhs->identifier->slot);
+                    Number after = calc(interpreter, before, value, assign_base(expr2->op));
+                    Interpreter_set(interpreter, expr2->lhs->identifier->slot, after);
                     return after;
                 } else {
-                    Interpreter_set(interpreter, expr2->lhs->identifier->name, value);
+                    Interpreter_set(interpreter, expr2->lhs->identifier->slot, value);
                     return value;
                 }
             } else {
                 interpreter->error = 3;
                 return 0;
             }
+        } else if (expr2->op == OpAnd || expr2->op == OpOr) {
+            // short-circuit, the rhs only runs when the lhs does not decide the result
+            const int lhs = truthy(interpret_Expression(interpreter, expr2->lhs));
+            if (lhs == (expr2->op == OpOr)) {
+                return lhs;
+            }
+            return truthy(interpret_Expression(interpreter, expr2->rhs));
         } else {
-            return calc(interpreter, interpret_Expression(interpreter, expr2->lhs),
-                        interpret_Expression(interpreter, expr2->rhs), expr2->op);
+            // lhs first, as the vm and the jit do: the order of function arguments is unspecified in C
+            const Number lhs = interpret_Expression(interpreter, expr2->lhs);
+            const Number rhs = interpret_Expression(interpreter, expr2->rhs);
+            return calc(interpreter, lhs, rhs, expr2->op);
         }
     }
     // IMPL: implement other tags
-    report_error(interpreter->error, RuntimeError, "Unknown expression tag");
+    report(interpreter, RuntimeError, "Unknown expression tag");
+    return 0;
+}
+
+/// a while in ModeJit: walked until it got hot, the rest of it runs as native code
+static Number interpret_While(struct Interpreter *interpreter, struct While *loop) {
+    int iterations = 0;
+    while (interpreter->error == Running) {
+        if (loop->native == nullptr && iterations >= interpreter->jit->threshold) {
+            const JitCode code = Jit_compile(interpreter->jit, loop);
+            loop->native = code ? (void *) code : JIT_REJECTED;
+        }
+        if (loop->native != nullptr && loop->native != JIT_REJECTED) {
+            if (((JitCode) loop->native)(interpreter->variables)) {
+                report(interpreter, MathError, NAN_MESSAGE);
+            }
+            return 0;
+        }
+        if (!(interpret_Expression(interpreter, loop->cond) > eps)) {
+            return 0;
+        }
+        interpret_Block(interpreter, loop->block);
+        iterations++;
+    }
     return 0;
 }
 
-long double interpret_Statement(struct Interpreter *interpreter, struct Statement *stmt) {
+static Number execute_Statement(struct Interpreter *interpreter, struct Statement *stmt);
+
+/// a statement under --profile: its time without the statements run inside it is its self time
+static Number profile_Statement(struct Interpreter *interpreter, struct Statement *stmt) {
+    struct Profile *profile = interpreter->profile;
+    const long long outer = profile->inner;
+    profile->inner = 0;
+    const long long start = profile_now();
+    const Number rv = execute_Statement(interpreter, stmt);
+    const long long total = profile_now() - start;
+    profile_statement(profile, stmt, total, total - profile->inner);
+    profile->inner = outer + total;
+    return rv;
+}
+
+Number interpret_Statement(struct Interpreter *interpreter, struct Statement *stmt) {
+    if (interpreter->profile) {
+        return profile_Statement(interpreter, stmt);
+    }
+    return execute_Statement(interpreter, stmt);
+}
+
+static Number execute_Statement(struct Interpreter *interpreter, struct Statement *stmt) {
     if (stmt->tag == GExpression) {
         return interpret_Expression(interpreter, stmt->expr);
     }
     if (stmt->tag == GIf) {
-        const long double condition = interpret_Expression(interpreter, stmt->if_stmt->cond);
+        const Number condition = interpret_Expression(interpreter, stmt->if_stmt->cond);
         if (condition < eps) {
             return interpret_Block(interpreter, stmt->if_stmt->else_block);
         } else {
@@ -145,37 +241,84 @@ long double interpret_Statement(struct Interpreter *interpreter, struct Statemen
         }
     }
     if (stmt->tag == GWhile) {
-        while (interpret_Expression(interpreter, stmt->while_stmt->cond) > eps) {
+        if (interpreter->mode == ModeJit) {
+            return interpret_While(interpreter, stmt->while_stmt);
+        }
+        while (interpret_Expression(interpreter, stmt->while_stmt->cond) > eps && interpreter->error == Running) {
             interpret_Block(interpreter, stmt->while_stmt->block);
         }
         return 0;
     }
+    if (stmt->tag == GBlock) {
+        return interpret_Block(interpreter, stmt->block);
+    }
+    report(interpreter, RuntimeError, "Unknown statement tag");
+    return 0;
 }
 
-long double interpret_Block(struct Interpreter *interpreter, struct Block *block) {
+/**
+ * Run the statements of block
+ *
+ * The run stops at the first error, the same place as in the vm and the jit: the statement that failed ends
+ * without storing a variable or calling a builtin, and no statement or loop iteration starts after it.
+ */
+Number interpret_Block(struct Interpreter *interpreter, struct Block *block) {
     struct Statement **stmt = block->stmts;
-    long double rv = 0;
-    while (stmt[0]->tag != GNull) {
+    Number rv = 0;
+    while (stmt[0]->tag != GNull && interpreter->error == Running) {
         rv = interpret_Statement(interpreter, *stmt);
         stmt++;
     }
     return rv;
 }
 
-long double interpret_file(struct Interpreter *interpreter, struct Block *block) {
-    long double rv = interpret_Block(interpreter, block);
+/// Success and rv if the run did not fail, nan otherwise
+static Number interpret_result(struct Interpreter *interpreter, const Number rv) {
+    Output_flush(interpreter->output); // the end of a program is a flush point, also when it failed
     if (interpreter->error == Running) {
         interpreter->error = Success;
         return rv;
     }
-    return nanl("");
+    return NUM(nan)("");
+}
+
+Number interpret_file(struct Interpreter *interpreter, struct Block *block) {
+    if (interpreter->mode != ModeBytecode) {
+        Interpreter_reserve(interpreter);
+        return interpret_result(interpreter, interpret_Block(interpreter, block));
+    }
+    Program_refresh(interpreter->program);
+    compile_file(interpreter->program, block);
+    if (interpreter->program->error != Success) {
+        report(interpreter, interpreter->program->error, interpreter->program->message);
+        return NUM(nan)("");
+    }
+    return interpret_compiled(interpreter, interpreter->program);
+}
+
+/// run a program compiled for this interpreter's symbols, by interpret_file or kept in a ProgramCache
+Number interpret_compiled(struct Interpreter *interpreter, const struct Program *program) {
+    Interpreter_reserve(interpreter);
+    return interpret_result(interpreter, interpret_Program(interpreter, program));
 }
 
 void Interpreter_delete(struct Interpreter *interpreter) {
+    Program_delete(interpreter->program);
+    Output_delete(interpreter->output);
+    Input_delete(interpreter->input);
+    Jit_delete(interpreter->jit);
+    if (interpreter->profile) {
+        Profile_delete(interpreter->profile);
+    }
+    Symbols_delete(interpreter->symbols);
+    free(interpreter->variables);
+    free(interpreter->stack);
     free(interpreter);
 }
 
 void Interpreter_refresh(struct Interpreter *interpreter) {
     // memset(interpreter->variables, -1, sizeof(interpreter->variables)); // keep the variables in repl
     interpreter->error = Running;
+    interpreter->message = nullptr;
+    Jit_reset(interpreter->jit); // a new AST is coming, the old While.native go with the old one
 }
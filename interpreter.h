@@ -0,0 +1,73 @@
+# pragma once
+# ifndef INTERPRETER_H
+# define INTERPRETER_H
+# include <stdio.h>
+# include "base.h"
+# include "number.h"
+# include "tokenizer.h"
+
+struct Expression;
+struct Statement;
+struct Block;
+struct Program;
+struct Symbols;
+struct Output;
+struct Input;
+struct Jit;
+struct Profile;
+
+/// How interpret_file runs a parsed block
+enum ExecMode {
+    ModeBytecode, /// compile to bytecode and run it on the vm (default)
+    ModeTreeWalk, /// walk the AST directly, kept as the reference implementation
+    ModeJit, /// walk the AST, while loops that get hot run as native code (jit.h)
+};
+
+struct Interpreter {
+    struct Symbols *symbols; /// name -> slot, filled by resolve_file
+    Number *variables; /// variables[slot], nan until assigned
+    int variable_count;
+    enum Error error;
+    const char *message; /// text of the last error, see report.h
+    enum ExecMode mode;
+    struct Program *program; /// compiled by interpret_file in ModeBytecode, reused between calls
+    Number *stack; /// vm operand stack, grown to program->max_depth
+    int stack_size;
+    unsigned long long random_state; /// random() state, one per interpreter so threads never share it
+    struct Output *output; /// print() writes here through a buffer, stdout by default, see output.h
+    struct Input *input; /// input() reads from here, stdin by default, see input.h
+    struct Jit *jit; /// compiled loops of the current AST in ModeJit
+    struct Profile *profile; /// nullptr, or counts and times of what the walker runs (profile.h), owned
+};
+
+# define RANDOM_SEED 0x2545f4914f6cdd1dULL
+
+struct Interpreter *Interpreter_create();
+
+void Interpreter_refresh(struct Interpreter *interpreter);
+
+void Interpreter_delete(struct Interpreter *interpreter);
+
+
+void Interpreter_reserve(struct Interpreter *interpreter); // make room for every resolved symbol
+
+Number calc(struct Interpreter *interpreter, Number a, Number b, enum Operator op);
+
+Number Interpreter_get(const struct Interpreter *interpreter, int slot);
+
+void Interpreter_set(struct Interpreter *interpreter, int slot, Number value);
+
+
+Number interpret_Expression(struct Interpreter *interpreter, struct Expression *expr);
+
+Number interpret_Statement(struct Interpreter *interpreter, struct Statement *stmt);
+
+Number interpret_Block(struct Interpreter *interpreter, struct Block *block);
+
+Number interpret_Program(struct Interpreter *interpreter, const struct Program *program); // see vm.c
+
+Number interpret_file(struct Interpreter *interpreter, struct Block *block);
+
+Number interpret_compiled(struct Interpreter *interpreter, const struct Program *program);
+
+# endif //INTERPRETER_H
@@ -0,0 +1,582 @@
+# include <math.h>
+# include <stdint.h>
+# include <stdlib.h>
+# include <string.h>
+# include <sys/mman.h>
+# include <unistd.h>
+# include "base.h"
+# include "tokenizer.h"
+# include "parser.h"
+# include "jit.h"
+
+// Loop jit
+// one pass over the AST of a while straight to machine code, expressions live in xmm0..xmm7 like an operand stack
+
+/// mmap'd code of one loop
+struct JitChunk {
+    void *code;
+    size_t size;
+    struct JitChunk *next;
+};
+
+/// Jit.constructor
+struct Jit *Jit_create() {
+    struct Jit *jit = malloc(sizeof(struct Jit));
+    if (!jit) {
+        panic("out of memory!", 1)
+    }
+    jit->threshold = JIT_THRESHOLD;
+    jit->chunks = nullptr;
+    jit->compiled = 0;
+    jit->rejected = 0;
+    return jit;
+}
+
+void Jit_reset(struct Jit *jit) {
+    while (jit->chunks) {
+        struct JitChunk *next = jit->chunks->next;
+        munmap(jit->chunks->code, jit->chunks->size);
+        free(jit->chunks);
+        jit->chunks = next;
+    }
+}
+
+/// Jit.destructor
+void Jit_delete(struct Jit *jit) {
+    Jit_reset(jit);
+    free(jit);
+}
+
+# if defined(WINZIG_DOUBLE) && defined(__x86_64__)
+
+# define VAR_REGS 8 /// variables in xmm8..xmm15
+# define MAX_DEPTH 5 /// an expression at depth d uses xmm d..d+2
+
+struct Fixup {
+    size_t at; /// the disp32 of a rip relative load
+    int index; /// into consts
+};
+
+/// machine code being written, labels are byte offsets into code
+struct Asm {
+    unsigned char *code;
+    size_t count;
+    size_t size;
+    uint64_t *consts;
+    int const_count;
+    int const_size;
+    struct Fixup *fixups;
+    int fixup_count;
+    int fixup_size;
+    size_t *exits; /// the rel32 of every jump taken on an assigned nan, they land at the end of the function
+    int exit_count;
+    int exit_size;
+    int slots[VAR_REGS]; /// slots[i] lives in xmm(8 + i)
+    int slot_count;
+    int sse41;
+    double lt_eps; /// x < lt_eps is x < eps for every double x, eps may be a long double
+    double gt_eps; /// x > gt_eps is x > eps
+    int failed;
+};
+
+# define ensure_capacity(ptr, count, size) \
+    if ((count) >= (size)) { \
+        (size) = (size) ? (size) * 2 : 64; \
+        void *new_memory = realloc((ptr), sizeof(*(ptr)) * (size)); \
+        if (!new_memory) { \
+            panic("out of memory!", 1) \
+        } \
+        (ptr) = new_memory; \
+    }
+
+static void byte(struct Asm *a, const int value) {
+    ensure_capacity(a->code, a->count, a->size);
+    a->code[a->count++] = (unsigned char) value;
+}
+
+static void u32(struct Asm *a, const uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        byte(a, (int) (value >> 8 * i & 0xff));
+    }
+}
+
+static void patch32(struct Asm *a, const size_t at, const uint32_t value) {
+    memcpy(a->code + at, &value, 4);
+}
+
+static int add_const(struct Asm *a, const double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, 8);
+    for (int i = 0; i < a->const_count; i++) {
+        if (a->consts[i] == bits) {
+            return i;
+        }
+    }
+    ensure_capacity(a->consts, a->const_count, a->const_size);
+    a->consts[a->const_count] = bits;
+    return a->const_count++;
+}
+
+/// [prefix] [REX] 0F op ModRM, reg and rm are xmm registers
+static void op_rr(struct Asm *a, const int prefix, const int op, const int reg, const int rm) {
+    if (prefix) {
+        byte(a, prefix);
+    }
+    if (reg >= 8 || rm >= 8) {
+        byte(a, 0x40 | (reg >= 8) << 2 | (rm >= 8));
+    }
+    byte(a, 0x0f);
+    byte(a, op);
+    byte(a, 0xc0 | (reg & 7) << 3 | (rm & 7));
+}
+
+/// same with the operand [rdi + slot * 8], rdi is the variables argument
+static void op_var(struct Asm *a, const int prefix, const int op, const int reg, const int slot) {
+    byte(a, prefix);
+    if (reg >= 8) {
+        byte(a, 0x44);
+    }
+    byte(a, 0x0f);
+    byte(a, op);
+    byte(a, 0x80 | (reg & 7) << 3 | 7);
+    u32(a, (uint32_t) slot * 8);
+}
+
+/// movsd reg, [rip + constant], the pool goes after the code
+static void load_const(struct Asm *a, const int reg, const double value) {
+    if (value == 0 && !signbit(value)) {
+        op_rr(a, 0x66, 0x57, reg, reg); // xorpd
+        return;
+    }
+    const int index = add_const(a, value);
+    byte(a, 0xf2);
+    if (reg >= 8) {
+        byte(a, 0x44);
+    }
+    byte(a, 0x0f);
+    byte(a, 0x10);
+    byte(a, 0x05 | (reg & 7) << 3);
+    ensure_capacity(a->fixups, a->fixup_count, a->fixup_size);
+    a->fixups[a->fixup_count].at = a->count;
+    a->fixups[a->fixup_count].index = index;
+    a->fixup_count++;
+    u32(a, 0);
+}
+
+static void load_mask(struct Asm *a, const int reg, const uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, 8);
+    load_const(a, reg, value);
+}
+
+# define ABS_MASK 0x7fffffffffffffffULL
+
+static void movapd(struct Asm *a, const int to, const int from) {
+    if (to != from) {
+        op_rr(a, 0x66, 0x28, to, from);
+    }
+}
+
+static void cmpsd(struct Asm *a, const int x, const int y, const int predicate) {
+    op_rr(a, 0xf2, 0xc2, x, y);
+    byte(a, predicate);
+}
+
+/// rax = the low 64 bits of xmm x (x < 8), then test rax, rax
+static void test_mask(struct Asm *a, const int x) {
+    byte(a, 0x66);
+    byte(a, 0x48);
+    byte(a, 0x0f);
+    byte(a, 0x7e);
+    byte(a, 0xc0 | x << 3);
+    byte(a, 0x48);
+    byte(a, 0x85);
+    byte(a, 0xc0);
+}
+
+/// jcc rel32 (0x84 jz, 0x85 jnz) or jmp rel32 (condition 0), return where to patch
+static size_t jump(struct Asm *a, const int condition) {
+    if (condition) {
+        byte(a, 0x0f);
+        byte(a, condition);
+    } else {
+        byte(a, 0xe9);
+    }
+    u32(a, 0);
+    return a->count - 4;
+}
+
+static void land(struct Asm *a, const size_t at, const size_t target) {
+    patch32(a, at, (uint32_t) (target - (at + 4)));
+}
+
+static int var_reg(const struct Asm *a, const int slot) {
+    for (int i = 0; i < a->slot_count; i++) {
+        if (a->slots[i] == slot) {
+            return 8 + i;
+        }
+    }
+    return -1;
+}
+
+static void load_var(struct Asm *a, const int x, const int slot) {
+    const int reg = var_reg(a, slot);
+    if (reg >= 0) {
+        movapd(a, x, reg);
+    } else {
+        op_var(a, 0xf2, 0x10, x, slot);
+    }
+}
+
+static void store_var(struct Asm *a, const int x, const int slot) {
+    const int reg = var_reg(a, slot);
+    if (reg >= 0) {
+        movapd(a, reg, x);
+    } else {
+        op_var(a, 0xf2, 0x11, x, slot);
+    }
+}
+
+/// x = truthy(x) as an all-ones mask, t is clobbered
+static void truth_mask(struct Asm *a, const int x, const int t) {
+    load_mask(a, t, ABS_MASK);
+    op_rr(a, 0x66, 0x54, x, t); // andpd, |x|
+    load_const(a, t, 1.0);
+    cmpsd(a, t, x, 2); // 1 <= |x|, false for nan
+    movapd(a, x, t);
+}
+
+/// x = x op y like calc, y and t are clobbered
+static void binary(struct Asm *a, const enum Operator op, const int x, const int y, const int t) {
+    switch (op) {
+        case OpAdd: op_rr(a, 0xf2, 0x58, x, y); return;
+        case OpSub: op_rr(a, 0xf2, 0x5c, x, y); return;
+        case OpMul: op_rr(a, 0xf2, 0x59, x, y); return;
+        case OpDiv: op_rr(a, 0xf2, 0x5e, x, y); return;
+        case OpLt: cmpsd(a, x, y, 1); break;
+        case OpLe: cmpsd(a, x, y, 2); break;
+        case OpEq: cmpsd(a, x, y, 0); break;
+        case OpNe: cmpsd(a, x, y, 4); break; // unordered is true, like != on a nan
+        case OpGt: cmpsd(a, y, x, 1); movapd(a, x, y); break;
+        case OpGe: cmpsd(a, y, x, 2); movapd(a, x, y); break;
+        case OpAnd: // only for &= |=, both sides are computed anyway
+        case OpOr:
+            truth_mask(a, x, t);
+            truth_mask(a, y, t);
+            op_rr(a, 0x66, op == OpAnd ? 0x54 : 0x56, x, y); // andpd, orpd
+            break;
+        default:
+            a->failed = 1; // ^ would need a call to pow
+            return;
+    }
+    load_const(a, t, 1.0);
+    op_rr(a, 0x66, 0x54, x, t); // mask -> 0 or 1
+}
+
+/// compute expr into xmm d
+static void gen_Expression(struct Asm *a, const struct Expression *expr, const int d) {
+    if (d > MAX_DEPTH) {
+        a->failed = 1;
+        return;
+    }
+    switch (expr->tag) {
+        case GLiteral:
+            load_const(a, d, expr->literal->value);
+            return;
+        case GIdentifier:
+            load_var(a, d, expr->identifier->slot);
+            return;
+        case GBuiltin:
+            gen_Expression(a, expr->builtin->expr, d);
+            switch (expr->builtin->id) {
+                case BuiltinSqrt:
+                    op_rr(a, 0xf2, 0x51, d, d);
+                    return;
+                case BuiltinAbs:
+                    load_mask(a, d + 1, ABS_MASK);
+                    op_rr(a, 0x66, 0x54, d, d + 1);
+                    return;
+                case BuiltinFloor:
+                    if (!a->sse41) {
+                        break;
+                    }
+                    byte(a, 0x66); // roundsd d, d, round down without the precision exception
+                    byte(a, 0x0f);
+                    byte(a, 0x3a);
+                    byte(a, 0x0b);
+                    byte(a, 0xc0 | (d & 7) << 3 | (d & 7));
+                    byte(a, 0x09);
+                    return;
+                default:
+                    break;
+            }
+            a->failed = 1; // other builtins are calls into libm or have side effects
+            return;
+        case GExpr2:
+            break;
+        default:
+            a->failed = 1;
+            return;
+    }
+
+    const struct Expr2 *expr2 = expr->expr2;
+    if (expr2->op == OpAnd || expr2->op == OpOr) {
+        // short-circuit like the walker: the rhs may assign, it only runs when the lhs does not decide
+        gen_Expression(a, expr2->lhs, d);
+        truth_mask(a, d, d + 1);
+        load_const(a, d + 1, 1.0);
+        op_rr(a, 0x66, 0x54, d, d + 1); // 0 or 1, the result if the rhs is skipped
+        test_mask(a, d);
+        const size_t to_end = jump(a, expr2->op == OpAnd ? 0x84 : 0x85);
+        gen_Expression(a, expr2->rhs, d);
+        truth_mask(a, d, d + 1);
+        load_const(a, d + 1, 1.0);
+        op_rr(a, 0x66, 0x54, d, d + 1);
+        land(a, to_end, a->count);
+        return;
+    }
+    if (!is_assign_op(expr2->op)) {
+        gen_Expression(a, expr2->lhs, d);
+        gen_Expression(a, expr2->rhs, d + 1);
+        binary(a, expr2->op, d, d + 1, d + 2);
+        return;
+    }
+    if (expr2->lhs->tag != GIdentifier) {
+        a->failed = 1;
+        return;
+    }
+    const int slot = expr2->lhs->identifier->slot;
+    gen_Expression(a, expr2->rhs, d);
+    if (expr2->op != OpAssign) {
+        // the value first, then the variable, as in interpret_Expression
+        load_var(a, d + 1, slot);
+        binary(a, assign_base(expr2->op), d + 1, d, d + 2);
+        movapd(a, d, d + 1);
+    }
+    store_var(a, d, slot);
+    if (!expr2->lhs->identifier->hoisted) {
+        op_rr(a, 0x66, 0x2e, d, d); // ucomisd d, d: parity is set for a nan
+        ensure_capacity(a->exits, a->exit_count, a->exit_size);
+        a->exits[a->exit_count++] = jump(a, 0x8a); // jp: the run stops at the store, as in Interpreter_set
+    }
+}
+
+static void gen_Block(struct Asm *a, const struct Block *block);
+
+static void gen_While(struct Asm *a, const struct While *loop) {
+    const size_t top = a->count;
+    gen_Expression(a, loop->cond, 0);
+    load_const(a, 1, a->gt_eps);
+    cmpsd(a, 1, 0, 1); // eps < cond
+    test_mask(a, 1);
+    const size_t to_end = jump(a, 0x84);
+    gen_Block(a, loop->block);
+    land(a, jump(a, 0), top);
+    land(a, to_end, a->count);
+}
+
+static void gen_Statement(struct Asm *a, const struct Statement *stmt) {
+    switch (stmt->tag) {
+        case GExpression:
+            gen_Expression(a, stmt->expr, 0);
+            return;
+        case GBlock:
+            gen_Block(a, stmt->block);
+            return;
+        case GIf: {
+            gen_Expression(a, stmt->if_stmt->cond, 0);
+            load_const(a, 1, a->lt_eps);
+            cmpsd(a, 0, 1, 1); // cond < eps
+            test_mask(a, 0);
+            const size_t to_else = jump(a, 0x85);
+            gen_Block(a, stmt->if_stmt->then_block);
+            const size_t to_end = jump(a, 0);
+            land(a, to_else, a->count);
+            gen_Block(a, stmt->if_stmt->else_block);
+            land(a, to_end, a->count);
+            return;
+        }
+        case GWhile:
+            gen_While(a, stmt->while_stmt);
+            return;
+        default:
+            a->failed = 1;
+    }
+}
+
+static void gen_Block(struct Asm *a, const struct Block *block) {
+    for (struct Statement **stmt = block->stmts; stmt[0]->tag != GNull && !a->failed; stmt++) {
+        gen_Statement(a, *stmt);
+    }
+}
+
+/// how often every slot is used, for picking the variables that get a register
+struct SlotUse {
+    int slot;
+    int count;
+};
+
+struct SlotUses {
+    struct SlotUse *uses;
+    int count;
+    int size;
+};
+
+static void count_Block(struct SlotUses *uses, const struct Block *block);
+
+static void count_Expression(struct SlotUses *uses, const struct Expression *expr) {
+    if (expr->tag == GIdentifier) {
+        for (int i = 0; i < uses->count; i++) {
+            if (uses->uses[i].slot == expr->identifier->slot) {
+                uses->uses[i].count++;
+                return;
+            }
+        }
+        ensure_capacity(uses->uses, uses->count, uses->size);
+        uses->uses[uses->count].slot = expr->identifier->slot;
+        uses->uses[uses->count].count = 1;
+        uses->count++;
+    } else if (expr->tag == GExpr2) {
+        count_Expression(uses, expr->expr2->lhs);
+        count_Expression(uses, expr->expr2->rhs);
+    } else if (expr->tag == GBuiltin) {
+        count_Expression(uses, expr->builtin->expr);
+    }
+}
+
+static void count_Statement(struct SlotUses *uses, const struct Statement *stmt) {
+    switch (stmt->tag) {
+        case GExpression:
+            count_Expression(uses, stmt->expr);
+            break;
+        case GBlock:
+            count_Block(uses, stmt->block);
+            break;
+        case GIf:
+            count_Expression(uses, stmt->if_stmt->cond);
+            count_Block(uses, stmt->if_stmt->then_block);
+            count_Block(uses, stmt->if_stmt->else_block);
+            break;
+        case GWhile:
+            count_Expression(uses, stmt->while_stmt->cond);
+            count_Block(uses, stmt->while_stmt->block);
+            break;
+        default:
+            break;
+    }
+}
+
+static void count_Block(struct SlotUses *uses, const struct Block *block) {
+    for (struct Statement **stmt = block->stmts; stmt[0]->tag != GNull; stmt++) {
+        count_Statement(uses, *stmt);
+    }
+}
+
+static int by_count(const void *a, const void *b) {
+    return ((const struct SlotUse *) b)->count - ((const struct SlotUse *) a)->count;
+}
+
+/// the most used variables of the loop go to xmm8..xmm15
+static void pick_registers(struct Asm *a, const struct While *loop) {
+    struct SlotUses uses = {nullptr, 0, 0};
+    count_Expression(&uses, loop->cond);
+    count_Block(&uses, loop->block);
+    qsort(uses.uses, uses.count, sizeof(struct SlotUse), by_count);
+    a->slot_count = uses.count < VAR_REGS ? uses.count : VAR_REGS;
+    for (int i = 0; i < a->slot_count; i++) {
+        a->slots[i] = uses.uses[i].slot;
+    }
+    free(uses.uses);
+}
+
+/// the whole function: load the register variables, run the loop, store them back and return whether a nan stopped it
+static void gen_function(struct Asm *a, const struct While *loop) {
+    for (int i = 0; i < a->slot_count; i++) {
+        op_var(a, 0xf2, 0x10, 8 + i, a->slots[i]);
+    }
+    gen_While(a, loop);
+    byte(a, 0x31); // xor eax, eax
+    byte(a, 0xc0);
+    const size_t store = a->count;
+    for (int i = 0; i < a->slot_count; i++) {
+        op_var(a, 0xf2, 0x11, 8 + i, a->slots[i]);
+    }
+    byte(a, 0xc3); // ret
+    for (int i = 0; i < a->exit_count; i++) {
+        land(a, a->exits[i], a->count);
+    }
+    byte(a, 0xb8); // mov eax, 1
+    u32(a, 1);
+    land(a, jump(a, 0), store);
+}
+
+/// copy the code and its constants to fresh executable memory
+static JitCode Jit_install(struct Jit *jit, struct Asm *a) {
+    while (a->count % 8) {
+        byte(a, 0xcc); // int3
+    }
+    const size_t pool = a->count;
+    for (int i = 0; i < a->fixup_count; i++) {
+        const struct Fixup fixup = a->fixups[i];
+        land(a, fixup.at, pool + fixup.index * 8);
+    }
+    const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t used = pool + a->const_count * 8;
+    const size_t size = (used + page - 1) / page * page;
+    unsigned char *code = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        return nullptr;
+    }
+    memcpy(code, a->code, pool);
+    memcpy(code + pool, a->consts, a->const_count * 8);
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, size);
+        return nullptr;
+    }
+    struct JitChunk *chunk = malloc(sizeof(struct JitChunk));
+    if (!chunk) {
+        panic("out of memory!", 1)
+    }
+    chunk->code = code;
+    chunk->size = size;
+    chunk->next = jit->chunks;
+    jit->chunks = chunk;
+    return (JitCode) code;
+}
+
+JitCode Jit_compile(struct Jit *jit, const struct While *loop) {
+    struct Asm a = {0};
+    a.sse41 = __builtin_cpu_supports("sse4.1");
+    a.lt_eps = (double) eps;
+    if (a.lt_eps < eps) {
+        a.lt_eps = nextafter(a.lt_eps, INFINITY);
+    }
+    a.gt_eps = (double) eps;
+    if (a.gt_eps > eps) {
+        a.gt_eps = nextafter(a.gt_eps, -INFINITY);
+    }
+    pick_registers(&a, loop);
+    gen_function(&a, loop);
+    JitCode code = a.failed ? nullptr : Jit_install(jit, &a);
+    free(a.code);
+    free(a.consts);
+    free(a.fixups);
+    free(a.exits);
+    if (code) {
+        jit->compiled++;
+    } else {
+        jit->rejected++;
+    }
+    return code;
+}
+
+# undef ensure_capacity
+
+# else
+
+JitCode Jit_compile(struct Jit *jit, const struct While *loop) {
+    jit->rejected++; // long double has no SSE instructions, and there is no encoder for other machines
+    return nullptr;
+}
+
+# endif
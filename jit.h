@@ -0,0 +1,44 @@
+# pragma once
+# ifndef JIT_H
+# define JIT_H
+# include <stddef.h>
+# include "base.h"
+# include "number.h"
+
+struct While;
+
+/// iterations a while runs in the tree walker before it is compiled
+# define JIT_THRESHOLD 1000
+
+/// While.native of a loop the jit can't compile, it stays in the walker
+# define JIT_REJECTED ((void *) 1)
+
+/// a compiled while: runs the loop to its end on variables, or returns 1 right after a nan was assigned
+typedef int (*JitCode)(Number *variables);
+
+///
+/// Native x86-64 code for hot while loops, used by ModeJit.
+///
+/// Only with WINZIG_DOUBLE on x86-64: the loop becomes SSE2 scalar code with up to 8 variables in registers.
+/// Supported: literals, variables, + - * / and comparisons, & |, assignments (not ^=), if, nested while,
+/// sqrt, abs and floor (SSE4.1). Anything else, or another build, rejects the loop and the walker keeps it.
+///
+/// A compiled loop keeps the walker's semantics: & | branch over their right side like the walker does,
+/// and an assigned nan stops the loop right after its store, the walker reports it as Interpreter_set does.
+///
+struct Jit {
+    int threshold; /// JIT_THRESHOLD by default, 0 compiles every while before its first iteration
+    struct JitChunk *chunks; /// executable memory of the compiled loops
+    int compiled;
+    int rejected;
+};
+
+struct Jit *Jit_create();
+
+void Jit_reset(struct Jit *jit); // frees the code, call it when the AST holding While.native goes away
+
+void Jit_delete(struct Jit *jit);
+
+JitCode Jit_compile(struct Jit *jit, const struct While *loop); // nullptr if the loop can't be compiled
+
+# endif //JIT_H
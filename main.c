@@ -4,5 +4,5 @@
 // can eval +-*/(), math function call, variable, assignment, simple loop, if-else, function definition and call
 
 int main(int argc, char *argv[]) {
-    winzig_ez_main(argc, argv);
+    return winzig_ez_main(argc, argv);
 }
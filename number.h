@@ -0,0 +1,31 @@
+# pragma once
+# ifndef NUMBER_H
+# define NUMBER_H
+
+///
+/// The one data type of winzig, picked at compile time.
+///
+/// long double by default (x87 80 bit on x86-64).
+/// Define WINZIG_DOUBLE to use double instead: SSE arithmetic and half the memory, about 16 significant digits.
+///
+/// NUM(f) names the math function f for Number, sqrt -> sqrtl or sqrt.
+///
+# ifdef WINZIG_DOUBLE
+typedef double Number;
+# define NUM(f) f
+# define NUMBER_FORMAT "%f"
+# define number_parse(str, end) strtod(str, end)
+# else
+typedef long double Number;
+# define NUM(f) f##l
+# define NUMBER_FORMAT "%Lf"
+# define number_parse(str, end) strtold(str, end)
+# endif
+
+/// truth of an operand of & and |, (long long) x != 0 without the cast, nan is false
+/// a function, not a macro: the walker passes it an expression that may assign, it must run once
+static inline int truthy(const Number x) {
+    return x >= 1 || x <= -1;
+}
+
+# endif //NUMBER_H
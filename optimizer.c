@@ -0,0 +1,498 @@
+# include <stdint.h>
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include "base.h"
+# include "tokenizer.h"
+# include "parser.h"
+# include "interpreter.h"
+# include "arena.h"
+# include "symbols.h"
+# include "optimizer.h"
+
+/// no assignment and no builtin with side effects inside, so evaluating it fewer times changes nothing
+int is_pure(const struct Expression *expr) {
+    switch (expr->tag) {
+        case GLiteral:
+        case GIdentifier:
+            return 1;
+        case GExpr2:
+            return !is_assign_op(expr->expr2->op) && is_pure(expr->expr2->lhs) && is_pure(expr->expr2->rhs);
+        case GBuiltin:
+            return builtin_is_pure(expr->builtin->func) && is_pure(expr->builtin->expr);
+        default:
+            return 0;
+    }
+}
+
+static int is_literal(const struct Expression *expr, const Number value) {
+    return expr->tag == GLiteral && expr->literal->value == value;
+}
+
+/// x ^ n as a chain of multiplications, x is a leaf so repeating it costs nothing
+static struct Expression *power_chain(struct Parser *parser, struct Expression *x, const int n) {
+    struct Expression *result = x;
+    for (int i = 1; i < n; i++) {
+        result = Expr2_create(parser, result, x, OpMul);
+    }
+    return result;
+}
+
+static struct Expression *optimize_Expression(struct Parser *parser, struct Expression *expr);
+
+static struct Expression *optimize_Expr2(struct Parser *parser, struct Expression *expr) {
+    struct Expr2 *expr2 = expr->expr2;
+    expr2->rhs = optimize_Expression(parser, expr2->rhs);
+    if (is_assign_op(expr2->op)) {
+        return expr; // lhs is the variable to assign
+    }
+    expr2->lhs = optimize_Expression(parser, expr2->lhs);
+    struct Expression *lhs = expr2->lhs;
+    struct Expression *rhs = expr2->rhs;
+
+    if (lhs->tag == GLiteral && rhs->tag == GLiteral && expr2->op >= OpAdd && expr2->op <= OpNe) {
+        // only plain operators get here, calc never touches the interpreter for them
+        return Literal_create(parser, calc(nullptr, lhs->literal->value, rhs->literal->value, expr2->op));
+    }
+
+    switch (expr2->op) {
+        case OpMul:
+            if (is_literal(rhs, 1)) return lhs;
+            if (is_literal(lhs, 1)) return rhs;
+            break;
+        case OpDiv:
+            if (is_literal(rhs, 1)) return lhs;
+            break;
+        case OpSub:
+            if (is_literal(rhs, 0)) return lhs;
+            break;
+        case OpPow:
+            if (is_literal(rhs, 1)) return lhs;
+            if (is_literal(rhs, 0) && is_pure(lhs)) return Literal_create(parser, 1); // pow(nan, 0) is 1 as well
+            if (lhs->tag == GIdentifier) {
+                if (is_literal(rhs, 2)) return power_chain(parser, lhs, 2);
+                if (is_literal(rhs, 3)) return power_chain(parser, lhs, 3);
+                if (is_literal(rhs, 4)) return power_chain(parser, lhs, 4);
+                if (is_literal(rhs, -1)) return Expr2_create(parser, Literal_create(parser, 1), lhs, OpDiv);
+            }
+            break;
+        case OpAnd:
+            if (lhs->tag == GLiteral && !truthy(lhs->literal->value)) return Literal_create(parser, 0); // rhs never runs
+            break;
+        case OpOr:
+            if (lhs->tag == GLiteral && truthy(lhs->literal->value)) return Literal_create(parser, 1);
+            break;
+        default:
+            break;
+    }
+    return expr;
+}
+
+static struct Expression *optimize_Expression(struct Parser *parser, struct Expression *expr) {
+    switch (expr->tag) {
+        case GExpr2:
+            return optimize_Expr2(parser, expr);
+        case GBuiltin:
+            expr->builtin->expr = optimize_Expression(parser, expr->builtin->expr);
+            if (expr->builtin->expr->tag == GLiteral && builtin_is_pure(expr->builtin->func)) {
+                return Literal_create(parser, expr->builtin->func(nullptr, expr->builtin->expr->literal->value));
+            }
+            return expr;
+        default:
+            return expr;
+    }
+}
+
+static void optimize_Block(struct Parser *parser, struct Block *block);
+
+static void optimize_Statement(struct Parser *parser, struct Statement *stmt) {
+    switch (stmt->tag) {
+        case GExpression:
+            stmt->expr = optimize_Expression(parser, stmt->expr);
+            break;
+        case GBlock:
+            optimize_Block(parser, stmt->block);
+            break;
+        case GIf: {
+            struct If *if_stmt = stmt->if_stmt;
+            if_stmt->cond = optimize_Expression(parser, if_stmt->cond);
+            optimize_Block(parser, if_stmt->then_block);
+            optimize_Block(parser, if_stmt->else_block);
+            if (if_stmt->cond->tag == GLiteral) {
+                // same test as interpret_Statement, the if becomes the block that would run
+                stmt->tag = GBlock;
+                stmt->block = if_stmt->cond->literal->value < eps ? if_stmt->else_block : if_stmt->then_block;
+            }
+            break;
+        }
+        case GWhile: {
+            struct While *while_stmt = stmt->while_stmt;
+            while_stmt->cond = optimize_Expression(parser, while_stmt->cond);
+            optimize_Block(parser, while_stmt->block);
+            if (while_stmt->cond->tag == GLiteral && !(while_stmt->cond->literal->value > eps)) {
+                // never runs, a while evaluates to 0 like an empty block
+                stmt->tag = GBlock;
+                stmt->block = Arena_alloc(parser->arena, sizeof(struct Block));
+                stmt->block->stmts = Arena_alloc(parser->arena, sizeof(struct Statement *));
+                stmt->block->stmts[0] = Statement_create(parser, GNull);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void optimize_Block(struct Parser *parser, struct Block *block) {
+    for (struct Statement **stmt = block->stmts; stmt[0]->tag != GNull; stmt++) {
+        optimize_Statement(parser, *stmt);
+    }
+}
+
+// Loop-invariant code motion
+// after folding, every while moves what can't change between its iterations into temporaries before it
+
+/// a temporary of the current loop by the structural hash of its expression, see hoist_temp
+struct HoistEntry {
+    unsigned long long hash;
+    int index; /// into Hoist.stmts
+    int loop; /// Hoist.loop it was made in, older entries count as empty
+};
+
+struct Hoist {
+    struct Parser *parser;
+    struct Symbols *symbols;
+    int temps; /// temporaries made so far, named $0, $1, ... so the repl reuses their slots
+    const char *assigned; /// assigned[slot] of the current loop, written somewhere in its cond or body
+    struct Statement **stmts; /// `$n = invariant` of the current loop, in order
+    int count;
+    int size;
+
+    struct HoistEntry *table; /// open addressing, so finding an equal temporary does not scan all of them
+    unsigned int capacity; /// power of 2
+    int loop; /// bumped for every while, empties the table without clearing it
+};
+
+static void mark_Block(char *assigned, const struct Block *block);
+
+static void mark_Expression(char *assigned, const struct Expression *expr) {
+    if (expr->tag == GExpr2) {
+        if (is_assign_op(expr->expr2->op) && expr->expr2->lhs->tag == GIdentifier) {
+            assigned[expr->expr2->lhs->identifier->slot] = 1;
+        }
+        mark_Expression(assigned, expr->expr2->lhs);
+        mark_Expression(assigned, expr->expr2->rhs);
+    } else if (expr->tag == GBuiltin) {
+        mark_Expression(assigned, expr->builtin->expr);
+    }
+}
+
+static void mark_Statement(char *assigned, const struct Statement *stmt) {
+    switch (stmt->tag) {
+        case GExpression:
+            mark_Expression(assigned, stmt->expr);
+            break;
+        case GBlock:
+            mark_Block(assigned, stmt->block);
+            break;
+        case GIf:
+            mark_Expression(assigned, stmt->if_stmt->cond);
+            mark_Block(assigned, stmt->if_stmt->then_block);
+            mark_Block(assigned, stmt->if_stmt->else_block);
+            break;
+        case GWhile:
+            mark_Expression(assigned, stmt->while_stmt->cond);
+            mark_Block(assigned, stmt->while_stmt->block);
+            break;
+        default:
+            break;
+    }
+}
+
+static void mark_Block(char *assigned, const struct Block *block) {
+    for (struct Statement **stmt = block->stmts; stmt[0]->tag != GNull; stmt++) {
+        mark_Statement(assigned, *stmt);
+    }
+}
+
+/// the same value every iteration: pure (print, input, random and exit are barriers) and no variable assigned in the loop
+static int is_invariant(const struct Hoist *hoist, const struct Expression *expr) {
+    switch (expr->tag) {
+        case GLiteral:
+            return 1;
+        case GIdentifier:
+            return !hoist->assigned[expr->identifier->slot];
+        case GExpr2:
+            return !is_assign_op(expr->expr2->op) && is_invariant(hoist, expr->expr2->lhs) &&
+                   is_invariant(hoist, expr->expr2->rhs);
+        case GBuiltin:
+            return builtin_is_pure(expr->builtin->func) && is_invariant(hoist, expr->builtin->expr);
+        default:
+            return 0;
+    }
+}
+
+static int is_same(const struct Expression *a, const struct Expression *b) {
+    if (a->tag != b->tag) {
+        return 0;
+    }
+    switch (a->tag) {
+        case GLiteral:
+            return a->literal->value == b->literal->value;
+        case GIdentifier:
+            return a->identifier->slot == b->identifier->slot;
+        case GExpr2:
+            return a->expr2->op == b->expr2->op && is_same(a->expr2->lhs, b->expr2->lhs) &&
+                   is_same(a->expr2->rhs, b->expr2->rhs);
+        case GBuiltin:
+            return a->builtin->func == b->builtin->func && is_same(a->builtin->expr, b->builtin->expr);
+        default:
+            return 0;
+    }
+}
+
+/// hash of the structure of expr, is_same expressions hash the same
+static unsigned long long expr_hash(const struct Expression *expr) {
+    unsigned long long hash = expr->tag;
+    switch (expr->tag) {
+        case GLiteral: {
+            double value = (double) expr->literal->value; // every Number that compares equal gives one double
+            if (value == 0) {
+                value = 0; // -0 == 0
+            }
+            unsigned long long bits;
+            memcpy(&bits, &value, sizeof(bits));
+            hash ^= bits;
+            break;
+        }
+        case GIdentifier:
+            hash ^= (unsigned long long) expr->identifier->slot << 8;
+            break;
+        case GExpr2:
+            hash ^= expr->expr2->op << 8;
+            hash = (hash ^ expr_hash(expr->expr2->lhs)) * 0x9e3779b97f4a7c15ULL;
+            hash = (hash ^ expr_hash(expr->expr2->rhs)) * 0x9e3779b97f4a7c15ULL;
+            break;
+        case GBuiltin:
+            hash ^= (unsigned long long) (uintptr_t) expr->builtin->func;
+            hash = (hash ^ expr_hash(expr->builtin->expr)) * 0x9e3779b97f4a7c15ULL;
+            break;
+        default:
+            break;
+    }
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    return hash ^ hash >> 31;
+}
+
+/// bucket of the temporary equal to expr, or the empty bucket where it should go
+static struct HoistEntry *hoist_probe(const struct Hoist *hoist, const struct Expression *expr,
+                                      const unsigned long long hash) {
+    const unsigned int mask = hoist->capacity - 1;
+    unsigned int i = (unsigned int) hash & mask;
+    while (1) {
+        struct HoistEntry *entry = &hoist->table[i];
+        if (entry->loop != hoist->loop) {
+            return entry;
+        }
+        if (entry->hash == hash && is_same(hoist->stmts[entry->index]->expr->expr2->rhs, expr)) {
+            return entry;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+/// double the table and put the temporaries of the current loop back
+static void hoist_grow(struct Hoist *hoist) {
+    free(hoist->table);
+    hoist->capacity = hoist->capacity ? hoist->capacity * 2 : 64;
+    hoist->table = malloc(sizeof(struct HoistEntry) * hoist->capacity);
+    if (!hoist->table) {
+        panic("out of memory!", 1)
+    }
+    for (unsigned int i = 0; i < hoist->capacity; i++) {
+        hoist->table[i].loop = -1;
+    }
+    for (int i = 0; i < hoist->count; i++) {
+        const struct Expression *rhs = hoist->stmts[i]->expr->expr2->rhs;
+        const unsigned long long hash = expr_hash(rhs);
+        struct HoistEntry *entry = hoist_probe(hoist, rhs, hash);
+        entry->hash = hash;
+        entry->index = i;
+        entry->loop = hoist->loop;
+    }
+}
+
+static struct Expression *temp_Identifier(struct Hoist *hoist, const char *name, const int slot) {
+    struct Expression *temp = Identifier_create(hoist->parser, name, (int) strlen(name));
+    temp->identifier->slot = slot;
+    temp->identifier->hoisted = 1;
+    return temp;
+}
+
+/// a temporary holding expr, computed before the loop; the same expression twice shares one
+static struct Expression *hoist_temp(struct Hoist *hoist, struct Expression *expr) {
+    if ((unsigned int) (hoist->count + 1) * 4 > hoist->capacity * 3) {
+        hoist_grow(hoist);
+    }
+    const unsigned long long hash = expr_hash(expr);
+    struct HoistEntry *entry = hoist_probe(hoist, expr, hash);
+    if (entry->loop == hoist->loop) {
+        const struct Expr2 *assign = hoist->stmts[entry->index]->expr->expr2;
+        return temp_Identifier(hoist, assign->lhs->identifier->name, assign->lhs->identifier->slot);
+    }
+    entry->hash = hash;
+    entry->index = hoist->count; // the statement is added below
+    entry->loop = hoist->loop;
+    char name[16];
+    snprintf(name, sizeof(name), "$%d", hoist->temps++);
+    const int slot = Symbols_intern(hoist->symbols, name);
+    hoist->symbols->defined[slot] = 1;
+
+    struct Statement *stmt = Statement_create(hoist->parser, GExpression);
+    stmt->expr = Expr2_create(hoist->parser, temp_Identifier(hoist, name, slot), expr, OpAssign);
+    if (hoist->count == hoist->size) {
+        hoist->size = hoist->size ? hoist->size * 2 : 4;
+        void *new_memory = realloc(hoist->stmts, sizeof(struct Statement *) * hoist->size);
+        if (!new_memory) {
+            panic("out of memory!", 1)
+        }
+        hoist->stmts = new_memory;
+    }
+    hoist->stmts[hoist->count++] = stmt;
+    return temp_Identifier(hoist, name, slot);
+}
+
+static struct Expression *hoist_operands(struct Hoist *hoist, struct Expression *expr);
+
+/// replace the largest invariant subexpressions, leaves are cheaper to read than a temporary
+static struct Expression *hoist_Expression(struct Hoist *hoist, struct Expression *expr) {
+    if ((expr->tag == GExpr2 || expr->tag == GBuiltin) && is_invariant(hoist, expr)) {
+        return hoist_temp(hoist, expr);
+    }
+    return hoist_operands(hoist, expr);
+}
+
+/// hoist_Expression below expr but not expr itself, for conditions (a constant one decides nothing)
+static struct Expression *hoist_operands(struct Hoist *hoist, struct Expression *expr) {
+    if (expr->tag == GExpr2) {
+        if (!is_assign_op(expr->expr2->op)) {
+            expr->expr2->lhs = hoist_Expression(hoist, expr->expr2->lhs);
+        }
+        expr->expr2->rhs = hoist_Expression(hoist, expr->expr2->rhs);
+    } else if (expr->tag == GBuiltin) {
+        expr->builtin->expr = hoist_Expression(hoist, expr->builtin->expr);
+    }
+    return expr;
+}
+
+static void hoist_from_Block(struct Hoist *hoist, struct Block *block);
+
+static void hoist_from_Statement(struct Hoist *hoist, struct Statement *stmt) {
+    switch (stmt->tag) {
+        case GExpression:
+            stmt->expr = hoist_Expression(hoist, stmt->expr);
+            break;
+        case GBlock:
+            hoist_from_Block(hoist, stmt->block);
+            break;
+        case GIf:
+            stmt->if_stmt->cond = hoist_operands(hoist, stmt->if_stmt->cond);
+            hoist_from_Block(hoist, stmt->if_stmt->then_block);
+            hoist_from_Block(hoist, stmt->if_stmt->else_block);
+            break;
+        case GWhile:
+            stmt->while_stmt->cond = hoist_operands(hoist, stmt->while_stmt->cond);
+            hoist_from_Block(hoist, stmt->while_stmt->block);
+            break;
+        default:
+            break;
+    }
+}
+
+static void hoist_from_Block(struct Hoist *hoist, struct Block *block) {
+    for (struct Statement **stmt = block->stmts; stmt[0]->tag != GNull; stmt++) {
+        hoist_from_Statement(hoist, *stmt);
+    }
+}
+
+static void hoist_Block(struct Hoist *hoist, struct Block *block);
+
+/// fill hoist->stmts with the temporaries of one while, its inner loops are done already
+static void hoist_While(struct Hoist *hoist, struct While *while_stmt) {
+    const int count = hoist->symbols->count;
+    char *assigned = calloc(count > 0 ? count : 1, 1);
+    if (!assigned) {
+        panic("out of memory!", 1)
+    }
+    mark_Expression(assigned, while_stmt->cond);
+    mark_Block(assigned, while_stmt->block);
+    hoist->assigned = assigned;
+    hoist->count = 0;
+    hoist->loop++;
+    while_stmt->cond = hoist_operands(hoist, while_stmt->cond);
+    hoist_from_Block(hoist, while_stmt->block);
+    free(assigned);
+}
+
+/// run the pass on every while in block, inner loops first, and put the temporaries in front of their loop
+static void hoist_Block(struct Hoist *hoist, struct Block *block) {
+    int length = 0;
+    int size = 0;
+    int added = 0;
+    struct Statement **stmts = nullptr;
+    for (struct Statement **stmt = block->stmts; stmt[0]->tag != GNull; stmt++) {
+        switch (stmt[0]->tag) {
+            case GBlock:
+                hoist_Block(hoist, stmt[0]->block);
+                break;
+            case GIf:
+                hoist_Block(hoist, stmt[0]->if_stmt->then_block);
+                hoist_Block(hoist, stmt[0]->if_stmt->else_block);
+                break;
+            case GWhile:
+                hoist_Block(hoist, stmt[0]->while_stmt->block);
+                hoist_While(hoist, stmt[0]->while_stmt);
+                break;
+            default:
+                break;
+        }
+        const int before = stmt[0]->tag == GWhile ? hoist->count : 0;
+        if (length + before + 1 > size) {
+            size = (length + before + 1) * 2;
+            void *new_memory = realloc(stmts, sizeof(struct Statement *) * size);
+            if (!new_memory) {
+                panic("out of memory!", 1)
+            }
+            stmts = new_memory;
+        }
+        for (int i = 0; i < before; i++) {
+            hoist->stmts[i]->line = stmt[0]->line; // the temporaries belong to the line of their loop
+            stmts[length++] = hoist->stmts[i];
+        }
+        stmts[length++] = *stmt;
+        added += before;
+        hoist->count = 0;
+    }
+    if (added > 0) {
+        // the block grows, the GNull end is kept
+        struct Statement **grown = Arena_alloc(hoist->parser->arena, sizeof(struct Statement *) * (length + 1));
+        memcpy(grown, stmts, sizeof(struct Statement *) * length);
+        grown[length] = block->stmts[length - added];
+        block->stmts = grown;
+    }
+    free(stmts);
+}
+
+/**
+ * Optimize parser->result_block in place, new nodes come from the parser arena
+ *
+ * @param parser a parser after parse_file (and resolve_file)
+ * @param symbols the symbols of resolve_file, loop-invariant temporaries get their slots there
+ */
+void optimize_file(struct Parser *parser, struct Symbols *symbols) {
+    optimize_Block(parser, parser->result_block);
+    struct Hoist hoist = {parser, symbols, 0, nullptr, nullptr, 0, 0, nullptr, 0, 0};
+    hoist_Block(&hoist, parser->result_block);
+    free(hoist.stmts);
+    free(hoist.table);
+}
@@ -0,0 +1,23 @@
+# pragma once
+# ifndef OPTIMIZER_H
+# define OPTIMIZER_H
+# include "base.h"
+
+struct Parser;
+struct Symbols;
+
+///
+/// AST optimizations, run between resolve_file and interpret_file.
+///
+/// - constant folding: operators and pure builtins whose operands are all Literal
+/// - identities that keep the exact value: x * 1, 1 * x, x / 1, x - 0, x ^ 1, pure x ^ 0
+/// - small integer powers become multiplications: x ^ 2, x ^ 3, x ^ 4, x ^ -1
+/// - if / while with a constant condition
+/// - loop-invariant code motion: pure subexpressions of a while whose variables are not assigned in it
+///   are computed once before the loop into temporaries ($0, $1, ... in symbols)
+///
+/// x + 0 is not touched, it turns -0 into +0.
+///
+void optimize_file(struct Parser *parser, struct Symbols *symbols);
+
+# endif //OPTIMIZER_H
@@ -0,0 +1,189 @@
+# include <errno.h>
+# include <stdarg.h>
+# include <math.h>
+# include <stdlib.h>
+# include <string.h>
+# include <unistd.h>
+# include "base.h"
+# include "output.h"
+
+// Output buffer
+// print() formats into the buffer without touching stdio, the sink sees one call per buffer
+
+/// Output.constructor, writes to stdout
+struct Output *Output_create(const size_t size) {
+    struct Output *output = malloc(sizeof(struct Output));
+    if (!output) {
+        panic("out of memory!", 1)
+    }
+    output->buffer = nullptr;
+    output->size = 0;
+    output->used = 0;
+    output->kind = OutputFile;
+    output->file = stdout;
+    output->fd = -1;
+    output->callback = nullptr;
+    output->context = nullptr;
+    Output_resize(output, size);
+    return output;
+}
+
+/// Output.destructor
+void Output_delete(struct Output *output) {
+    Output_flush(output);
+    free(output->buffer);
+    free(output);
+}
+
+/// hand data to the sink, bypassing the buffer
+static void Output_send(struct Output *output, const char *data, size_t length) {
+    switch (output->kind) {
+        case OutputFile:
+            fwrite(data, 1, length, output->file);
+            return;
+        case OutputFd:
+            while (length > 0) {
+                const ssize_t n = write(output->fd, data, length);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return; // a closed pipe, nobody reads the rest
+                }
+                data += n;
+                length -= n;
+            }
+            return;
+        case OutputCall:
+            output->callback(output->context, data, length);
+            return;
+    }
+}
+
+/// empty the buffer into the sink, a FILE is flushed too so the text is visible before input() waits
+void Output_flush(struct Output *output) {
+    if (output->used > 0) {
+        Output_send(output, output->buffer, output->used);
+        output->used = 0;
+    }
+    if (output->kind == OutputFile) {
+        fflush(output->file);
+    }
+}
+
+/// change the buffer size, what is buffered so far is flushed first
+void Output_resize(struct Output *output, const size_t size) {
+    Output_flush(output);
+    free(output->buffer);
+    output->buffer = nullptr;
+    if (size > 0) {
+        output->buffer = malloc(size);
+        if (!output->buffer) {
+            panic("out of memory!", 1)
+        }
+    }
+    output->size = size;
+}
+
+/// file is flushed again later, it must stay open until another sink is set or the Output is deleted
+void Output_set_file(struct Output *output, FILE *file) {
+    Output_flush(output);
+    output->kind = OutputFile;
+    output->file = file;
+}
+
+void Output_set_fd(struct Output *output, const int fd) {
+    Output_flush(output);
+    output->kind = OutputFd;
+    output->fd = fd;
+}
+
+/// every flush calls callback(context, data, length), data is only valid during the call
+void Output_set_callback(struct Output *output, const OutputCallback callback, void *context) {
+    Output_flush(output);
+    output->kind = OutputCall;
+    output->callback = callback;
+    output->context = context;
+}
+
+void output_write(struct Output *output, const char *data, const size_t length) {
+    if (output->used + length > output->size) {
+        Output_flush(output);
+        if (length > output->size) {
+            Output_send(output, data, length); // larger than the whole buffer
+            return;
+        }
+    }
+    memcpy(output->buffer + output->used, data, length);
+    output->used += length;
+}
+
+/// an integer with the 6 zero decimals of NUMBER_FORMAT, without printf, return the length
+static int format_integer(char *text, const long long value) {
+    char digits[24];
+    int count = 0;
+    unsigned long long rest = value < 0 ? -(unsigned long long) value : (unsigned long long) value;
+    do {
+        digits[count++] = (char) ('0' + rest % 10);
+        rest /= 10;
+    } while (rest > 0);
+    int length = 0;
+    if (value < 0) {
+        text[length++] = '-';
+    }
+    while (count > 0) {
+        text[length++] = digits[--count];
+    }
+    memcpy(text + length, ".000000\n", 8);
+    return length + 8;
+}
+
+/**
+ * Print x as print() does, NUMBER_FORMAT and a newline
+ *
+ * Whole numbers, the usual case for counters, are formatted by hand. The rest goes through snprintf.
+ */
+int output_number(struct Output *output, const Number x) {
+    char text[64];
+    int length;
+    if (x > -1e18 && x < 1e18 && x == (Number) (long long) x && !(x == 0 && signbit(x))) {
+        length = format_integer(text, (long long) x);
+    } else {
+        length = snprintf(text, sizeof(text), NUMBER_FORMAT "\n", x);
+        if (length >= (int) sizeof(text)) {
+            // something like 1e300, hundreds of digits
+            char *long_text = malloc(length + 1);
+            if (!long_text) {
+                panic("out of memory!", 1)
+            }
+            snprintf(long_text, length + 1, NUMBER_FORMAT "\n", x);
+            output_write(output, long_text, length);
+            free(long_text);
+            return length;
+        }
+    }
+    output_write(output, text, length);
+    return length;
+}
+
+/// printf into the buffer, for the rare text that is not a number (see print_Block)
+void output_format(struct Output *output, const char *format, ...) {
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    const int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length < (int) sizeof(text)) {
+        output_write(output, text, length);
+        return;
+    }
+    char *long_text = malloc(length + 1);
+    if (!long_text) {
+        panic("out of memory!", 1)
+    }
+    va_start(args, format);
+    vsnprintf(long_text, length + 1, format, args);
+    va_end(args);
+    output_write(output, long_text, length);
+    free(long_text);
+}
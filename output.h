@@ -0,0 +1,57 @@
+# pragma once
+# ifndef OUTPUT_H
+# define OUTPUT_H
+# include <stddef.h>
+# include <stdio.h>
+# include "base.h"
+# include "number.h"
+
+# define OUTPUT_BUFFER_SIZE 65536
+
+/// receives every flushed piece of output, see Output_set_callback
+typedef void (*OutputCallback)(void *context, const char *data, size_t length);
+
+enum OutputKind {
+    OutputFile, /// fwrite to a FILE, stdout by default
+    OutputFd, /// write(2) to a file descriptor, no stdio in between
+    OutputCall, /// hand the bytes to a callback
+};
+
+///
+/// Buffered sink of print() and of the AST dump (print_Block).
+///
+/// Text is collected in the buffer and only handed to the sink when it is full or on a flush:
+/// at the end of a program, before input() and on exit(). One per interpreter, never shared.
+///
+struct Output {
+    char *buffer;
+    size_t size; /// 0 writes everything through right away
+    size_t used;
+    enum OutputKind kind;
+    FILE *file;
+    int fd;
+    OutputCallback callback;
+    void *context;
+};
+
+struct Output *Output_create(size_t size);
+
+void Output_delete(struct Output *output); // flushes first
+
+void Output_resize(struct Output *output, size_t size);
+
+void Output_set_file(struct Output *output, FILE *file);
+
+void Output_set_fd(struct Output *output, int fd);
+
+void Output_set_callback(struct Output *output, OutputCallback callback, void *context);
+
+void Output_flush(struct Output *output);
+
+void output_write(struct Output *output, const char *data, size_t length);
+
+int output_number(struct Output *output, Number x); // one line in NUMBER_FORMAT, returns its length
+
+void output_format(struct Output *output, const char *format, ...); // printf into the buffer
+
+# endif //OUTPUT_H
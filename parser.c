@@ -1,6 +1,7 @@
 # include <stdlib.h>
 # include <string.h>
 # include "base.h"
+# include "report.h"
 # include "tokenizer.h"
 # include "parser.h"
 
@@ -13,220 +14,264 @@
 # include "tokenizer.h"
 # include "parser.h"
 # include "interpreter.h"
+# include "arena.h"
+# include "output.h"
+# include "input.h"
 
 
-long double my_print(struct Interpreter *interpreter, const long double x) {
-    return (long double) printf("%Lf\n", x);
-    return 0.0;
+Number my_print(struct Interpreter *interpreter, const Number x) {
+    return (Number) output_number(interpreter->output, x);
 }
 
-long double my_input(struct Interpreter *interpreter, const long double _) {
-    /// read a long double from stdin
-    long double x;
-    char buf[256];
-    char *end = nullptr;
+Number my_input(struct Interpreter *interpreter, const Number _) {
+    /// read a Number from interpreter->input
+    Number x;
+    const char *word;
+    int length;
+    Output_flush(interpreter->output); // everything printed so far shows up before waiting for input
     while (1) {
-        scanf("%s", buf);
-        if (buf[0] == 'Q' || buf[0] == 'q') {
+        const enum InputResult result = input_number(interpreter->input, &x, &word, &length);
+        if (result == InputEnd) {
+            // the end of the input counts as q
             interpreter->error = KeyboardInterrupt;
             return 0.0;
         }
-        x = strtold(buf, &end);
-        if (*end != '\0' || end == buf) {
-            printf("Not a valid number: %s\n", buf);
-            printf("Input Q to exit current program\n");
-        } else {
-            break;
+        if (result == InputNumber) {
+            return x;
+        }
+        if (!interpreter->input->interactive) {
+            report(interpreter, RuntimeError, "input is not a number");
+            return 0.0;
         }
+        char text[320];
+        const int size = snprintf(text, sizeof(text), "Not a valid number: %.*s\nInput Q to exit current program\n",
+                                  length < 256 ? length : 256, word);
+        output_write(interpreter->output, text, size);
+        Output_flush(interpreter->output);
     }
-    return x;
 }
 
-long double my_exit(struct Interpreter *interpreter, const long double _) {
+Number my_exit(struct Interpreter *interpreter, const Number _) {
+    Output_flush(interpreter->output);
     interpreter->error = KeyboardInterrupt;
     return 0.0;
 }
 
-long double sign(struct Interpreter *interpreter, const long double x) {
+Number sign(struct Interpreter *interpreter, const Number x) {
     return x > 0 ? 1.0 : (x < 0 ? -1.0 : 0.0);
 }
 
-long double boolean(struct Interpreter *interpreter, const long double x) {
+Number boolean(struct Interpreter *interpreter, const Number x) {
     return x > 0.0 ? 1.0 : 0.0;
 }
 
-long double my_random(struct Interpreter *interpreter, const long double _) {
-    return rand() / (long double) RAND_MAX;
+/// splitmix64 on the interpreter's own state, rand() would be shared by every thread
+Number my_random(struct Interpreter *interpreter, const Number _) {
+    unsigned long long z = interpreter->random_state += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ z >> 30) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ z >> 27) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return (Number) (z >> 11) / (Number) (1ULL << 53);
+}
+
+# define quick_my(name, func) Number my_##name(struct Interpreter *interpreter, const Number x) { return func(x); }
+quick_my(abs, NUM(fabs))
+quick_my(sin, NUM(sin))
+quick_my(cos, NUM(cos))
+quick_my(tan, NUM(tan))
+quick_my(asin, NUM(asin))
+quick_my(acos, NUM(acos))
+quick_my(atan, NUM(atan))
+quick_my(sqrt, NUM(sqrt))
+quick_my(log, NUM(log))
+quick_my(log10, NUM(log10))
+quick_my(exp, NUM(exp))
+quick_my(ceil, NUM(ceil))
+quick_my(floor, NUM(floor))
+quick_my(round, NUM(round))
+
+/// every builtin by name, kept sorted for builtin_find
+static const struct BuiltinInfo builtins[] = {
+    {"abs", BuiltinAbs, my_abs},
+    {"acos", BuiltinAcos, my_acos},
+    {"asin", BuiltinAsin, my_asin},
+    {"atan", BuiltinAtan, my_atan},
+    {"boolean", BuiltinBoolean, boolean},
+    {"ceil", BuiltinCeil, my_ceil},
+    {"cos", BuiltinCos, my_cos},
+    {"exit", BuiltinExit, my_exit},
+    {"exp", BuiltinExp, my_exp},
+    {"floor", BuiltinFloor, my_floor},
+    {"input", BuiltinInput, my_input},
+    {"log", BuiltinLog, my_log},
+    {"log10", BuiltinLog10, my_log10},
+    {"print", BuiltinPrint, my_print},
+    {"random", BuiltinRandom, my_random},
+    {"round", BuiltinRound, my_round},
+    {"sign", BuiltinSign, sign},
+    {"sin", BuiltinSin, my_sin},
+    {"sqrt", BuiltinSqrt, my_sqrt},
+    {"tan", BuiltinTan, my_tan},
+};
+
+/// the builtin named exactly name[0, length), binary search over the table, nullptr if there is none
+const struct BuiltinInfo *builtin_find(const char *name, const int length) {
+    int low = 0;
+    int high = sizeof(builtins) / sizeof(builtins[0]);
+    while (low < high) {
+        const int mid = (low + high) / 2;
+        int order = strncmp(name, builtins[mid].name, length);
+        if (order == 0 && builtins[mid].name[length] != '\0') {
+            order = -1; // name is a prefix of the entry
+        }
+        if (order == 0) {
+            return &builtins[mid];
+        }
+        if (order < 0) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return nullptr;
+}
+
+/// the table entry of a builtin, nullptr for BuiltinNone or an id out of range
+const struct BuiltinInfo *builtin_of(const enum BuiltinId id) {
+    for (int i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+        if (builtins[i].id == id) {
+            return &builtins[i];
+        }
+    }
+    return nullptr;
 }
 
-# define quick_my(name, func) long double my_##name(struct Interpreter *interpreter, const long double x) { return func(x); }
-quick_my(abs, fabsl)
-quick_my(sin, sinl)
-quick_my(cos, cosl)
-quick_my(tan, tanl)
-quick_my(asin, asinl)
-quick_my(acos, acosl)
-quick_my(atan, atanl)
-quick_my(sqrt, sqrtl)
-quick_my(log, logl)
-quick_my(log10, log10l)
-quick_my(exp, expl)
-quick_my(ceil, ceill)
-quick_my(floor, floorl)
-quick_my(round, roundl)
+/// name of a builtin, for reports
+const char *builtin_name(const enum BuiltinId id) {
+    const struct BuiltinInfo *info = builtin_of(id);
+    return info ? info->name : "";
+}
 
 /**
 * Provide built-in function with name
 * now provided: abs, sin, cos, tan, asin, acos, atan, sqrt, log, log10, exp, ceil, floor, round, etc.
 */
-long double (*get_func(const char *name))(struct Interpreter *, const long double) {
-# define check(label, func) if (strstr(name, label)) return &func;
-    check("abs", my_abs);
-    check("sin", my_sin);
-    check("cos", my_cos);
-    check("tan", my_tan);
-    check("asin", my_asin);
-    check("acos", my_acos);
-    check("atan", my_atan);
-    check("sqrt", my_sqrt);
-    check("log", my_log);
-    check("log10", my_log10);
-    check("exp", my_exp);
-    check("ceil", my_ceil);
-    check("floor", my_floor);
-    check("round", my_round);
-    check("print", my_print);
-    check("input", my_input);
-    check("sign", sign);
-    check("boolean", boolean);
-    check("random", my_random);
-    check("exit", my_exit);
-    return nullptr;
+Number (*get_func(const char *name))(struct Interpreter *, const Number) {
+    const struct BuiltinInfo *info = builtin_find(name, (int) strlen(name));
+    return info ? info->func : nullptr;
+}
+
+/// a builtin without side effects (no io, no random, no exit), safe to fold or call fewer times
+int builtin_is_pure(Number (*func)(struct Interpreter *, Number)) {
+    return func != nullptr && func != my_print && func != my_input && func != my_exit && func != my_random;
 }
 
-struct Expression *Literal_create(const long double value) {
-    struct Expression *expression = malloc(sizeof(struct Expression));
+struct Expression *Literal_create(struct Parser *parser, const Number value) {
+    struct Expression *expression = Arena_alloc(parser->arena, sizeof(struct Expression));
     expression->tag = GLiteral;
-    expression->literal = malloc(sizeof(struct Literal));
+    expression->literal = Arena_alloc(parser->arena, sizeof(struct Literal));
     expression->literal->value = value;
     return expression;
 }
 
-struct Expression *Identifier_create(const char *name) {
-    struct Expression *expression = malloc(sizeof(struct Expression));
+struct Expression *Identifier_create(struct Parser *parser, const char *name, const int length) {
+    struct Expression *expression = Arena_alloc(parser->arena, sizeof(struct Expression));
     expression->tag = GIdentifier;
-    expression->identifier = malloc(sizeof(struct Identifier));
-    expression->identifier->name = malloc(strlen(name) + 1);
-    strcpy(expression->identifier->name, name);
+    expression->identifier = Arena_alloc(parser->arena, sizeof(struct Identifier));
+    expression->identifier->name = Arena_strndup(parser->arena, name, length);
+    expression->identifier->slot = -1;
+    expression->identifier->hoisted = 0;
     return expression;
 }
 
-struct Expression *Expr2_create(struct Expression *lhs, struct Expression *rhs, const char *op) {
-    struct Expression *expression = malloc(sizeof(struct Expression));
+struct Expression *Expr2_create(struct Parser *parser, struct Expression *lhs, struct Expression *rhs,
+                                const enum Operator op) {
+    struct Expression *expression = Arena_alloc(parser->arena, sizeof(struct Expression));
     expression->tag = GExpr2;
-    expression->expr2 = malloc(sizeof(struct Expr2));
+    expression->expr2 = Arena_alloc(parser->arena, sizeof(struct Expr2));
     expression->expr2->lhs = lhs;
     expression->expr2->rhs = rhs;
-    expression->expr2->op = malloc(3 * sizeof(char));
-    strcpy(expression->expr2->op, op);
+    expression->expr2->op = op;
     return expression;
 }
 
-struct Expression *Builtin_create(const char *name, struct Expression *expr) {
-    struct Expression *expression = malloc(sizeof(struct Expression));
+struct Expression *Builtin_create(struct Parser *parser, const char *name, const int length, struct Expression *expr) {
+    struct Expression *expression = Arena_alloc(parser->arena, sizeof(struct Expression));
     expression->tag = GBuiltin;
-    expression->builtin = malloc(sizeof(struct Builtin));
-    expression->builtin->name = malloc(strlen(name) + 1);
-    strcpy(expression->builtin->name, name);
-    expression->builtin->func = get_func(name);
+    expression->builtin = Arena_alloc(parser->arena, sizeof(struct Builtin));
+    expression->builtin->name = Arena_strndup(parser->arena, name, length);
+    const struct BuiltinInfo *info = builtin_find(name, length);
+    expression->builtin->id = info ? info->id : BuiltinNone;
+    expression->builtin->func = info ? info->func : nullptr;
     expression->builtin->expr = expr;
     return expression;
 }
 
-/// Expression.destructor
-void Expr_delete(struct Expression *expr) {
-    if (expr == NULL) {
-        return;
+/// strtold on a number token, the slice is not NUL terminated and may be followed by a word ("1e5" is 2 tokens)
+Number token_value(const struct Token token) {
+    char buf[MAX_TOKEN_LEN];
+    char *text = buf;
+    if (token.length >= MAX_TOKEN_LEN) {
+        text = malloc(token.length + 1); // tokens have no length limit, rarely needed
+        if (!text) {
+            panic("out of memory!", 1)
+        }
     }
-    switch (expr->tag) {
-        case GLiteral:
-            break;
-        case GIdentifier:
-            free(expr->identifier->name);
-            free(expr->identifier);
-            break;
-        case GExpr2:
-            Expr_delete(expr->expr2->lhs);
-            Expr_delete(expr->expr2->rhs);
-            free(expr->expr2->op);
-            free(expr->expr2);
-            break;
-        case GExpr1:
-            Expr_delete(expr->expr1->expr);
-            free(expr->expr1->op);
-            free(expr->expr1);
-            break;
-        case GBuiltin:
-            Expr_delete(expr->builtin->expr);
-            free(expr->builtin->name);
-            free(expr->builtin);
-            break;
-        default:
-            break;
+    memcpy(text, token.token, token.length);
+    text[token.length] = '\0';
+    const Number value = number_parse(text, nullptr);
+    if (text != buf) {
+        free(text);
     }
-    free(expr);
+    return value;
 }
 
-/// Statement.destructor
-void Statement_delete(struct Statement *stmt) {
-    if (stmt == NULL) {
-        return;
-    }
-    switch (stmt->tag) {
-        case GExpression:
-            Expr_delete(stmt->expr);
-            break;
-        case GBlock:
-            Block_delete(stmt->block);
-            break;
-        case GIf:
-            Expr_delete(stmt->if_stmt->cond);
-            Block_delete(stmt->if_stmt->then_block);
-            Block_delete(stmt->if_stmt->else_block);
-            free(stmt->if_stmt);
-            break;
-        case GWhile:
-            Expr_delete(stmt->while_stmt->cond);
-            Block_delete(stmt->while_stmt->block);
-            free(stmt->while_stmt);
-            break;
-        default:
-            break; // this should not happen
-    }
-    free(stmt);
+/// an Expression with no payload, GNull or GError
+struct Expression *Expr_create(struct Parser *parser, const enum DataTag tag) {
+    struct Expression *expression = Arena_alloc(parser->arena, sizeof(struct Expression));
+    expression->tag = tag;
+    return expression;
 }
 
-/// Block.destructor
-void Block_delete(struct Block *block) {
-    if (block == NULL) {
-        return;
-    }
-    struct Statement **stmt = block->stmts;
-    while (stmt[0]->tag != GNull) {
-        Statement_delete(*stmt);
-        stmt++;
-    }
-    free(block);
+/// a Statement with no payload, GNull ends a Block
+struct Statement *Statement_create(struct Parser *parser, const enum DataTag tag) {
+    struct Statement *stmt = Arena_alloc(parser->arena, sizeof(struct Statement));
+    stmt->tag = tag;
+    stmt->line = 0;
+    return stmt;
 }
 
 struct Parser *Parser_create() {
     struct Parser *parser = malloc(sizeof(struct Parser));
+    parser->arena = Arena_create();
+    parser->result_block = nullptr;
     parser->error = Running;
+    parser->message = nullptr;
+    parser->exps = nullptr;
+    parser->exps_top = 0;
+    parser->exps_size = 0;
+    parser->ops = nullptr;
+    parser->ops_top = 0;
+    parser->ops_size = 0;
+    parser->stmts = nullptr;
+    parser->stmts_top = 0;
+    parser->stmts_size = 0;
     return parser;
 }
 
+/// grow a work stack of Parser, the same way Ts_push does
+# define ensure_capacity(ptr, count, size) \
+    if ((count) >= (size)) { \
+        (size) = (size) ? (size) * 2 : 64; \
+        void *new_memory = realloc(ptr, sizeof(*(ptr)) * (size)); \
+        if (!new_memory) { \
+            panic("out of memory!", 1) \
+        } \
+        (ptr) = new_memory; \
+    }
+
 /**
- * Get the priority of the operator.
+ * Get the priority of the operator, smaller binds tighter.
  *
  * Priority Table
  * Top
@@ -242,55 +287,33 @@ struct Parser *Parser_create() {
  * 10 = += -= *= /= ^= (calculate then assign)
  * 10 &= |= (logic then assign)
  */
-int operator_priority(const char *op) {
-    if (*op == '\0') {
-        return -1; // should not happen
+int operator_priority(const enum Operator op) {
+    static const int priority[OpCount] = {
+        [OpNone] = -1,
+        [OpLParen] = 1, [OpRParen] = 1, [OpLBrace] = -1, [OpRBrace] = -1,
+        [OpNot] = 2,
+        [OpPow] = 3,
+        [OpMul] = 4, [OpDiv] = 4,
+        [OpAdd] = 5, [OpSub] = 5,
+        [OpLt] = 6, [OpLe] = 6, [OpGt] = 6, [OpGe] = 6,
+        [OpEq] = 7, [OpNe] = 7,
+        [OpAnd] = 8,
+        [OpOr] = 9,
+        [OpAssign] = 10, [OpAddAssign] = 10, [OpSubAssign] = 10, [OpMulAssign] = 10, [OpDivAssign] = 10,
+        [OpPowAssign] = 10, [OpAndAssign] = 10, [OpOrAssign] = 10,
+    };
+    return priority[op];
+}
+
+/// should the operator on the stack be reduced before pushing op
+int reduce_before(const enum Operator top, const enum Operator op) {
+    if (top == OpLParen) {
+        return 0; // ( is a barrier, only ) removes it
     }
-    if (op[1] == '=') {
-        switch (*op) {
-            case '+':
-            case '-':
-            case '*':
-            case '/':
-            case '^':
-            case '&':
-            case '|':
-                return 10;
-            case '=':
-            case '!':
-                return 7;
-            case '<':
-            case '>':
-                return 6;
-            default:
-                return -1; // should not happen
-        }
-    }
-    switch (*op) {
-        case '(':
-        case ')':
-            return 1;
-        case '!':
-            return 2;
-        case '^':
-            return 3;
-        case '*':
-        case '/':
-            return 4;
-        case '+':
-        case '-':
-            return 5;
-        case '<':
-        case '>':
-            return 6;
-        // all 7 was processed above =
-        case '&':
-            return 8;
-        case '|':
-            return 9;
-        default:
-            return -1; // should not happen
+    if (is_assign_op(op)) {
+        return operator_priority(top) < operator_priority(op); // a = b = c is a = (b = c)
     }
+    return operator_priority(top) <= operator_priority(op);
 }
 
 /// Parse an expression
@@ -298,136 +321,161 @@ int operator_priority(const char *op) {
 /// @param tokens: the token data
 /// @param brace_flag: 1 for ( expr ), 0 for whole line
 struct Expression *parse_expression(struct Parser *parser, struct TokenData *tokens, const int brace_flag) {
-    struct Expression *exps[STACK_SIZE];
-    int expr_top = 0;
-    char ops[STACK_SIZE][3];
-    int op_top = 0;
+    // this call owns parser->exps[exps_base, exps_top) and parser->ops[ops_base, ops_top)
+    const int exps_base = parser->exps_top;
+    const int ops_base = parser->ops_top;
 
     int brace = 0;
     // use for if and while ( condition ), process until )
 
     struct Token token = Ts_pop(tokens);
 
-# define EPush(expr) if (expr_top < STACK_SIZE) exps[expr_top++] = expr; else report_error(parser->error, TooComplexGrammar, "too complex expression")
+# define EPush(expr) { \
+    ensure_capacity(parser->exps, parser->exps_top, parser->exps_size); \
+    parser->exps[parser->exps_top++] = expr; \
+}
 # define EPop2(lhs, rhs) \
-    if (expr_top > 1){ \
-        rhs = exps[--expr_top]; \
-        lhs = exps[--expr_top]; \
+    if (parser->exps_top - exps_base > 1){ \
+        rhs = parser->exps[--parser->exps_top]; \
+        lhs = parser->exps[--parser->exps_top]; \
     }else{ \
-        report_error(parser->error, UnexpectedEnd, "expr: unexpected end"); \
+        report(parser, UnexpectedEnd, "expr: unexpected end"); \
     break; \
 }
-# define OpPush(op) if (op_top < STACK_SIZE) strcpy(ops[op_top++], op); else report_error(parser->error, TooComplexGrammar, "too complex expression")
+# define OpPush(op) { \
+    ensure_capacity(parser->ops, parser->ops_top, parser->ops_size); \
+    parser->ops[parser->ops_top++] = op; \
+}
+# define op_top (parser->ops_top - ops_base)
+# define op_peek() (parser->ops[parser->ops_top - 1])
 # define OpPop(op) \
     if (op_top > 0){ \
-        op = malloc(3 * sizeof(char)); \
-        memcpy(op, ops[--op_top], 3); \
+        op = parser->ops[--parser->ops_top]; \
     }else{ \
-        report_error(parser->error, UnexpectedEnd, "op: unexpected end"); \
+        report(parser, UnexpectedEnd, "op: unexpected end"); \
         break; \
     }
 # define calc_once() {\
-    struct Expression *expression = malloc(sizeof(struct Expression));\
-    expression->tag = GExpr2;\
-    expression->expr2 = malloc(sizeof(struct Expr2));\
+    struct Expression *expression = Expr_create(parser, GExpr2);\
+    expression->expr2 = Arena_alloc(parser->arena, sizeof(struct Expr2));\
     EPop2(expression->expr2->lhs, expression->expr2->rhs);\
     OpPop(expression->expr2->op);\
     EPush(expression);\
     }
     if (token.tag == TokenNull) {
-        struct Expression *result = malloc(sizeof(struct Expression));
-        result->tag = GNull;
-        return result;
+        return Expr_create(parser, GNull);
     }
     // if (token.tag == TokenOperator && token.token[0] == '(') {
     //     brace_flag = 1;
     // }
     while (token.tag != TokenNull && token.tag != TokenLineSep && tokens->error == Success) {
         if (token.tag == TokenNumber) {
-            EPush(Literal_create(strtold(token.token, nullptr)));
+            EPush(Literal_create(parser, token_value(token)));
         } else if (token.tag == TokenWord) {
             // Tell if it is function call or variable
-            if (*Ts_peek(tokens).token == '(') {
+            const struct Token next = Ts_peek(tokens);
+            if (next.tag == TokenOperator && next.op == OpLParen) {
                 // a function call
-                struct Expression *expression = Builtin_create(token.token, parse_expression(parser, tokens, 1));
+                struct Expression *expression = Builtin_create(parser, token.token, token.length,
+                                                               parse_expression(parser, tokens, 1));
                 EPush(expression);
             } else {
                 // a variable
-                EPush(Identifier_create(token.token));
+                EPush(Identifier_create(parser, token.token, token.length));
             }
         } else if (token.tag == TokenOperator) {
-            if (token.token[0] == '(') {
+            if (token.op == OpLParen) {
                 brace++;
-            } else if (token.token[0] == ')') {
+                OpPush(OpLParen);
+            } else if (token.op == OpRParen) {
                 brace--;
-                while (op_top > 0 && ops[op_top][0] != '(') calc_once();
-                // 1: at least one ( in stack
-                // op_top--; // wrong, didn't push (
+                while (op_top > 0 && op_peek() != OpLParen) calc_once();
+                if (op_top > 0) parser->ops_top--; // the matching (
                 if (brace_flag && brace == 0) break;
-            } else if (token.token[0] == '}') {
+            } else if (token.op == OpRBrace) {
+                tokens->index--; // leave the } to parse_block
                 break;
             } else {
-                while (op_top > 0 && operator_priority(ops[op_top - 1]) >= operator_priority(token.token)) calc_once();
-                OpPush(token.token);
+                while (op_top > 0 && reduce_before(op_peek(), token.op)) calc_once();
+                OpPush(token.op);
             }
+        } else if (token.tag == TokenKeyword) {
+            report(parser, SyntaxError, "unexpected keyword");
+            break;
         }
         token = Ts_pop(tokens);
     }
     while (op_top > 0) {
+        if (op_peek() == OpLParen) {
+            report(parser, SyntaxError, "unclosed (");
+            break;
+        }
         calc_once();
     }
-    if (expr_top == 1) {
-        return exps[0];
+    struct Expression *result;
+    if (parser->exps_top - exps_base == 1) {
+        result = parser->exps[exps_base];
     } else {
-        struct Expression *result = malloc(sizeof(struct Expression));
-        result->tag = GError;
-        report_error(parser->error, SyntaxError, "didn't process all expressions");
-        return result;
+        result = Expr_create(parser, GError);
+        report(parser, SyntaxError, "didn't process all expressions");
     }
+    parser->exps_top = exps_base;
+    parser->ops_top = ops_base;
+    return result;
+# undef EPush
+# undef EPop2
+# undef OpPush
+# undef op_top
+# undef op_peek
+# undef OpPop
+# undef calc_once
 };
 
 /// Parse a statement
 struct Statement *parse_statement(struct Parser *parser, struct TokenData *tokens) {
     struct Token token = Ts_peek(tokens);
-    struct Statement *stmt = malloc(sizeof(struct Statement));
-    if (token.tag == TokenWord) {
-        if (strstr(token.token, "if")) {
+    struct Statement *stmt = Statement_create(parser, GNull);
+    stmt->line = token.line;
+    if (token.tag == TokenKeyword) {
+        if (token.keyword == KwIf) {
             Ts_pop(tokens);
             stmt->tag = GIf;
-            stmt->if_stmt = malloc(sizeof(struct If));
+            stmt->if_stmt = Arena_alloc(parser->arena, sizeof(struct If));
             stmt->if_stmt->cond = parse_expression(parser, tokens, 1);
             stmt->if_stmt->then_block = parse_block(parser, tokens, 1);
             const struct Token is_else = Ts_peek(tokens);
-            if (is_else.tag == TokenWord && strstr(is_else.token, "else")) {
+            if (is_else.tag == TokenKeyword && is_else.keyword == KwElse) {
                 Ts_advance(tokens);
                 stmt->if_stmt->else_block = parse_block(parser, tokens, 1);
             } else {
-                stmt->if_stmt->else_block = malloc(sizeof(struct Block));
-                stmt->if_stmt->else_block->stmts = malloc(sizeof(struct Statement *));
-                stmt->if_stmt->else_block->stmts[0] = malloc(sizeof(struct Statement));
-                stmt->if_stmt->else_block->stmts[0]->tag = GNull;
+                stmt->if_stmt->else_block = Arena_alloc(parser->arena, sizeof(struct Block));
+                stmt->if_stmt->else_block->stmts = Arena_alloc(parser->arena, sizeof(struct Statement *));
+                stmt->if_stmt->else_block->stmts[0] = Statement_create(parser, GNull);
             }
             // consume the newline, make sure
-        } else if (strstr(token.token, "while")) {
+        } else if (token.keyword == KwWhile) {
             Ts_pop(tokens);
             stmt->tag = GWhile;
-            stmt->while_stmt = malloc(sizeof(struct While));
+            stmt->while_stmt = Arena_alloc(parser->arena, sizeof(struct While));
             stmt->while_stmt->cond = parse_expression(parser, tokens, 1);
             stmt->while_stmt->block = parse_block(parser, tokens, 1);
+            stmt->while_stmt->native = nullptr;
             // consume the newline, make sure
         } else {
             stmt->tag = GExpression;
             stmt->expr = parse_expression(parser, tokens, 0);
         }
-    } else if (token.tag == TokenNumber) {
+    } else if (token.tag == TokenWord || token.tag == TokenNumber) {
         stmt->tag = GExpression;
         stmt->expr = parse_expression(parser, tokens, 0);
     } else if (token.tag == TokenOperator) {
-        if (token.token[0] == '{') {
-            parse_block(parser, tokens, 1);
+        if (token.op == OpLBrace) {
+            stmt->tag = GBlock;
+            stmt->block = parse_block(parser, tokens, 1);
+        } else {
+            stmt->tag = GExpression;
+            stmt->expr = parse_expression(parser, tokens, 0);
         }
-        stmt->tag = GExpression;
-        stmt->expr = parse_expression(parser, tokens, 0);
     } else if (token.tag == TokenNull) {
         stmt->tag = GNull;
     }
@@ -438,8 +486,11 @@ struct Statement *parse_statement(struct Parser *parser, struct TokenData *token
 /// Parse a block
 struct Block *parse_block(struct Parser *parser, struct TokenData *tokens, const int inner) {
     int brace = 0;
-    struct Token token = Ts_peek(tokens);
-    if (token.tag == TokenOperator && token.token[0] == '{') {
+    struct Token token;
+    while ((token = Ts_peek(tokens)).tag == TokenLineSep) {
+        Ts_advance(tokens);
+    }
+    if (token.tag == TokenOperator && token.op == OpLBrace) {
         Ts_advance(tokens);
         token = Ts_peek(tokens);
         if (token.tag == TokenLineSep) {
@@ -449,23 +500,23 @@ struct Block *parse_block(struct Parser *parser, struct TokenData *tokens, const
     }
     // use for { block }, process until }
     // if flag is 0, process whole file, until TokenNull
-    struct Block *block = malloc(sizeof(struct Block));
-    block->stmts = malloc(sizeof(struct Statement) * STACK_SIZE);
-    int index = 0;
+    // the statements collect on parser->stmts above base, inner blocks use the part above them
+    const int base = parser->stmts_top;
     while (1) {
         struct Statement *stmt = parse_statement(parser, tokens);
-        block->stmts[index++] = stmt;
+        ensure_capacity(parser->stmts, parser->stmts_top, parser->stmts_size);
+        parser->stmts[parser->stmts_top++] = stmt;
         if (stmt->tag == GNull || Ts_peek(tokens).tag == TokenNull) {
             break;
         }
+        if (inner && brace == 0) {
+            break; // if (x) y = 1, a single statement without { }
+        }
         while ((token = Ts_peek(tokens)).tag == TokenLineSep) {
             Ts_advance(tokens);
         }
 
-        if (token.tag == TokenOperator && token.token[0] == '{') {
-            brace++;
-        }
-        if (token.tag == TokenOperator && token.token[0] == '}') {
+        if (token.tag == TokenOperator && token.op == OpRBrace) {
             brace--;
             Ts_advance(tokens); // consume the }
             if (inner && brace == 0) {
@@ -473,8 +524,12 @@ struct Block *parse_block(struct Parser *parser, struct TokenData *tokens, const
             }
         }
     }
-    block->stmts[index] = malloc(sizeof(struct Statement));
-    block->stmts[index]->tag = GNull;
+    const int count = parser->stmts_top - base;
+    struct Block *block = Arena_alloc(parser->arena, sizeof(struct Block));
+    block->stmts = Arena_alloc(parser->arena, sizeof(struct Statement *) * (count + 1));
+    memcpy(block->stmts, parser->stmts + base, sizeof(struct Statement *) * count);
+    block->stmts[count] = Statement_create(parser, GNull);
+    parser->stmts_top = base;
     return block;
 }
 
@@ -490,70 +545,84 @@ void parse_file(struct Parser *parser, struct TokenData *tokens) {
 
 /// Parser.destructor
 void Parser_delete(struct Parser *parser) {
+    Arena_delete(parser->arena);
+    free(parser->exps);
+    free(parser->ops);
+    free(parser->stmts);
     free(parser);
 }
 
-/// Parser.refresh
+/// Parser.refresh: the whole tree lives in the arena, drop it in one go
 void Parser_refresh(struct Parser *parser) {
     parser->error = Running;
-    Block_delete(parser->result_block);
+    parser->message = nullptr;
+    Arena_reset(parser->arena);
     parser->result_block = nullptr;
+    parser->exps_top = 0; // an error may have left calls unwound
+    parser->ops_top = 0;
+    parser->stmts_top = 0;
 }
 
-void print_Expression(const struct Expression *expression) {
+void print_Expression(struct Output *output, const struct Expression *expression) {
     switch (expression->tag) {
         case GLiteral:
-            printf("%Lf", expression->literal->value);
+            output_format(output, NUMBER_FORMAT, expression->literal->value);
             break;
         case GIdentifier:
-            printf("%s", expression->identifier->name);
+            output_format(output, "%s", expression->identifier->name);
             break;
         case GExpr2:
-            printf("(");
-            print_Expression(expression->expr2->lhs);
-            printf(" %s ", expression->expr2->op);
-            print_Expression(expression->expr2->rhs);
-            printf(")");
+            output_format(output, "(");
+            print_Expression(output, expression->expr2->lhs);
+            output_format(output, " %s ", operator_names[expression->expr2->op]);
+            print_Expression(output, expression->expr2->rhs);
+            output_format(output, ")");
             break;
         case GBuiltin:
-            printf("%s(", expression->builtin->name);
-            print_Expression(expression->builtin->expr);
-            printf(")");
+            output_format(output, "%s(", expression->builtin->name);
+            print_Expression(output, expression->builtin->expr);
+            output_format(output, ")");
             break;
         default:
-            printf("<unknown>");
+            output_format(output, "<unknown>");
     }
 }
 
-void print_Statement(const struct Statement *statement) {
+void print_Statement(struct Output *output, const struct Statement *statement) {
     if (statement->tag == GExpression) {
-        print_Expression(statement->expr);
-        printf(";\n");
+        print_Expression(output, statement->expr);
+        output_format(output, ";\n");
         return;
     }
     if (statement->tag == GIf) {
-        printf("if");
-        print_Expression(statement->if_stmt->cond);
-        printf("{\n");
-        print_Block(statement->if_stmt->then_block);
-        printf("} else {\n");
-        print_Block(statement->if_stmt->else_block);
-        printf("}\n");
+        output_format(output, "if");
+        print_Expression(output, statement->if_stmt->cond);
+        output_format(output, "{\n");
+        print_Block(output, statement->if_stmt->then_block);
+        output_format(output, "} else {\n");
+        print_Block(output, statement->if_stmt->else_block);
+        output_format(output, "}\n");
         return;
     }
     if (statement->tag == GWhile) {
-        printf("while");
-        print_Expression(statement->while_stmt->cond);
-        printf("{\n");
-        print_Block(statement->while_stmt->block);
-        printf("}\n");
+        output_format(output, "while");
+        print_Expression(output, statement->while_stmt->cond);
+        output_format(output, "{\n");
+        print_Block(output, statement->while_stmt->block);
+        output_format(output, "}\n");
+        return;
+    }
+    if (statement->tag == GBlock) {
+        output_format(output, "{\n");
+        print_Block(output, statement->block);
+        output_format(output, "}\n");
         return;
     }
-    printf("<unknown>");
+    output_format(output, "<unknown>");
 }
 
-void print_Block(const struct Block *block) {
+void print_Block(struct Output *output, const struct Block *block) {
     for (int i = 0; block->stmts[i]->tag != GNull; i++) {
-        print_Statement(block->stmts[i]);
+        print_Statement(output, block->stmts[i]);
     }
 }
@@ -1,17 +1,24 @@
 # pragma once
 # ifndef PARSER_H
 # define PARSER_H
+# include <math.h>
 # include "base.h"
+# include "number.h"
+# include "tokenizer.h"
+
+struct Output;
 
 
 /// float literal
 struct Literal {
-    long double value;
+    Number value;
 };
 
 /// only variables now
 struct Identifier {
     char *name;
+    int slot; /// index into the interpreter variables, -1 until resolve_file
+    int hoisted; /// a temporary made by optimize_file for a loop invariant, assigned without the nan check
 };
 
 /// Binary operation
@@ -20,7 +27,7 @@ struct Identifier {
 struct Expr2 {
     struct Expression *lhs;
     struct Expression *rhs;
-    char *op;
+    enum Operator op;
     // +, -, *, /, &&, ||, ==, !=, <, <=, >, >=, etc.
     // =, +=, -=, *=, /=, %=, &=, |=, ^=, <<=, >>=, etc.
 };
@@ -29,7 +36,7 @@ struct Expr2 {
 /// Expr1 := Op1 Expression
 struct Expr1 {
     struct Expression *expr;
-    char *op;
+    enum Operator op;
     // possible unary operators: +, -, !, ~, etc.
 };
 
@@ -39,10 +46,29 @@ struct Expr1 {
 /// Builtin := func_name ( Expression )
 ///
 /// now provided: abs, sin, cos, tan, asin, acos, atan, sqrt, log, log10, exp, ceil, floor, round, etc.
-/// {@see {get_func}}
+/// {@see {builtin_find}}
 ///
+enum BuiltinId {
+    BuiltinNone, /// unknown name
+    BuiltinSqrt, BuiltinAbs, BuiltinSin, BuiltinCos, BuiltinExp, BuiltinLog, BuiltinFloor, /// intrinsics, see is_intrinsic
+    BuiltinTan, BuiltinAsin, BuiltinAcos, BuiltinAtan, BuiltinLog10, BuiltinCeil, BuiltinRound, BuiltinSign,
+    BuiltinBoolean, BuiltinPrint, BuiltinInput, BuiltinRandom, BuiltinExit,
+    BuiltinCount,
+};
+
+/// hot pure builtins the evaluators run inline instead of calling through func
+# define is_intrinsic(id) ((id) >= BuiltinSqrt && (id) <= BuiltinFloor)
+
+/// one entry of the builtin table, sorted by name
+struct BuiltinInfo {
+    const char *name;
+    enum BuiltinId id;
+    Number (*func)(struct Interpreter *, Number);
+};
+
 struct Builtin {
-    long double (*func)(struct Interpreter *, long double);
+    enum BuiltinId id;
+    Number (*func)(struct Interpreter *, Number);
     char *name;
     struct Expression *expr;
 };
@@ -86,6 +112,7 @@ struct Block {
 struct While {
     struct Expression *cond;
     struct Block *block;
+    void *native; /// machine code once the loop got hot in ModeJit, or JIT_REJECTED, see jit.h
 };
 
 /// If statement
@@ -98,6 +125,7 @@ struct If {
 /// Any statement
 struct Statement {
     enum DataTag tag;
+    int line; /// source line of its first token, 0 for statements made up by the parser like the GNull end of a block
 
     union {
         struct Expression *expr;
@@ -111,9 +139,27 @@ struct Statement {
     };
 };
 
+///
+/// All nodes of result_block (and the names and strings in them) are allocated from arena,
+/// so there is no per node free, Parser_refresh drops the whole tree at once.
+///
 struct Parser {
+    struct Arena *arena;
     struct Block *result_block;
     enum Error error;
+    const char *message; /// text of the last error, see report.h
+
+    // work stacks, shared by the nested parse_expression and parse_block calls, every call uses the part above
+    // the top it found and gives it back; they grow and are kept between files
+    struct Expression **exps; /// operands of parse_expression
+    int exps_top;
+    int exps_size;
+    enum Operator *ops; /// operators of parse_expression
+    int ops_top;
+    int ops_size;
+    struct Statement **stmts; /// statements of the blocks being parsed, copied to an exact array at the }
+    int stmts_top;
+    int stmts_size;
 };
 
 struct Parser *Parser_create();
@@ -123,11 +169,42 @@ void Parser_refresh(struct Parser *parser);
 void Parser_delete(struct Parser *parser);
 
 
-void Expr_delete(struct Expression *expr);
+const struct BuiltinInfo *builtin_find(const char *name, int length);
+
+const struct BuiltinInfo *builtin_of(enum BuiltinId id);
+
+const char *builtin_name(enum BuiltinId id); // "" for BuiltinNone
+
+Number (*get_func(const char *name))(struct Interpreter *, Number);
+
+/// evaluate an intrinsic directly, inline so the switch folds into the callers' dispatch
+static inline Number intrinsic_call(const enum BuiltinId id, const Number x) {
+    switch (id) {
+        case BuiltinSqrt: return NUM(sqrt)(x);
+        case BuiltinAbs: return NUM(fabs)(x);
+        case BuiltinSin: return NUM(sin)(x);
+        case BuiltinCos: return NUM(cos)(x);
+        case BuiltinExp: return NUM(exp)(x);
+        case BuiltinLog: return NUM(log)(x);
+        case BuiltinFloor: return NUM(floor)(x);
+        default: return x;
+    }
+}
+
+int builtin_is_pure(Number (*func)(struct Interpreter *, Number));
+
+
+struct Expression *Literal_create(struct Parser *parser, Number value);
+
+struct Expression *Identifier_create(struct Parser *parser, const char *name, int length);
+
+struct Expression *Expr2_create(struct Parser *parser, struct Expression *lhs, struct Expression *rhs, enum Operator op);
+
+struct Expression *Builtin_create(struct Parser *parser, const char *name, int length, struct Expression *expr);
 
-void Block_delete(struct Block *block);
+struct Expression *Expr_create(struct Parser *parser, enum DataTag tag);
 
-void Statement_delete(struct Statement *stmt);
+struct Statement *Statement_create(struct Parser *parser, enum DataTag tag);
 
 
 void parse_file(struct Parser *parser, struct TokenData *tokens); // free tokens
@@ -138,10 +215,11 @@ struct Expression *parse_expression(struct Parser *parser, struct TokenData *tok
 // read until TokenNewline
 
 
-void print_Statement(const struct Statement *statement);
+// the AST as source text, written to output (the interpreter's, so every instance keeps its own sink)
+void print_Statement(struct Output *output, const struct Statement *statement);
 
-void print_Block(const struct Block *block);
+void print_Block(struct Output *output, const struct Block *block);
 
-void print_Expression(const struct Expression *expression);
+void print_Expression(struct Output *output, const struct Expression *expression);
 
 # endif //PARSER_H
@@ -0,0 +1,186 @@
+# include <stdlib.h>
+# include <unistd.h>
+# include "base.h"
+# include "pool.h"
+
+// Work-stealing thread pool
+// items are handed out in chunks, a queue only holds a range of chunk indexes so taking or stealing is O(1)
+
+struct PoolWorker {
+    struct Pool *pool;
+    int index;
+};
+
+/// next chunk of the own queue, nothing if it is empty
+static int Pool_take(struct PoolQueue *queue, size_t *chunk) {
+    pthread_mutex_lock(&queue->lock);
+    const int found = queue->begin < queue->end;
+    if (found) {
+        *chunk = queue->begin++;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+/// move the back half of another queue into the own one
+static int Pool_steal(struct Pool *pool, const int thief) {
+    for (int i = 1; i < pool->thread_count; i++) {
+        struct PoolQueue *victim = &pool->queues[(thief + i) % pool->thread_count];
+        pthread_mutex_lock(&victim->lock);
+        const size_t left = victim->end - victim->begin;
+        if (left == 0) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        const size_t end = victim->end;
+        victim->end -= (left + 1) / 2;
+        const size_t begin = victim->end;
+        pthread_mutex_unlock(&victim->lock);
+
+        struct PoolQueue *own = &pool->queues[thief];
+        pthread_mutex_lock(&own->lock);
+        own->begin = begin;
+        own->end = end;
+        pthread_mutex_unlock(&own->lock);
+        return 1;
+    }
+    return 0;
+}
+
+static void *Pool_work(void *arg) {
+    const struct PoolWorker *worker = arg;
+    struct Pool *pool = worker->pool;
+    const int index = worker->index;
+    unsigned long seen = 0;
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == seen && !pool->quit) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->quit) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        size_t chunk;
+        while (1) {
+            if (!Pool_take(&pool->queues[index], &chunk)) {
+                if (!Pool_steal(pool, index)) {
+                    break; // every queue is empty, the rest is being run already
+                }
+                continue;
+            }
+            const size_t begin = chunk * pool->chunk;
+            const size_t end = begin + pool->chunk < pool->count ? begin + pool->chunk : pool->count;
+            pool->task(pool->context, index, begin, end);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    free(arg);
+    return nullptr;
+}
+
+/// Pool.constructor
+struct Pool *Pool_create(int thread_count) {
+    if (thread_count <= 0) {
+        thread_count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        if (thread_count <= 0) {
+            thread_count = 1;
+        }
+    }
+    struct Pool *pool = malloc(sizeof(struct Pool));
+    if (!pool) {
+        panic("out of memory!", 1)
+    }
+    pool->thread_count = thread_count;
+    pool->threads = malloc(sizeof(pthread_t) * thread_count);
+    pool->queues = malloc(sizeof(struct PoolQueue) * thread_count);
+    if (!pool->threads || !pool->queues) {
+        panic("out of memory!", 1)
+    }
+    pthread_mutex_init(&pool->lock, nullptr);
+    pthread_cond_init(&pool->start, nullptr);
+    pthread_cond_init(&pool->done, nullptr);
+    pool->generation = 0;
+    pool->running = 0;
+    pool->quit = 0;
+    pool->task = nullptr;
+    pool->context = nullptr;
+    pool->count = 0;
+    pool->chunk = 1;
+    for (int i = 0; i < thread_count; i++) {
+        pthread_mutex_init(&pool->queues[i].lock, nullptr);
+        pool->queues[i].begin = 0;
+        pool->queues[i].end = 0;
+    }
+    for (int i = 0; i < thread_count; i++) {
+        struct PoolWorker *worker = malloc(sizeof(struct PoolWorker));
+        if (!worker) {
+            panic("out of memory!", 1)
+        }
+        worker->pool = pool;
+        worker->index = i;
+        if (pthread_create(&pool->threads[i], nullptr, Pool_work, worker) != 0) {
+            panic("cannot create thread!", 1)
+        }
+    }
+    return pool;
+}
+
+/// Pool.destructor: wakes the workers and joins them
+void Pool_delete(struct Pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], nullptr);
+        pthread_mutex_destroy(&pool->queues[i].lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool->queues);
+    free(pool);
+}
+
+/**
+ * Run task over items [0, count) on all workers
+ *
+ * @param chunk items per task call, the unit of stealing
+ * @param task called with consecutive ranges, each item exactly once, from any worker
+ */
+void Pool_run(struct Pool *pool, const size_t count, size_t chunk, const PoolTask task, void *context) {
+    if (count == 0) {
+        return;
+    }
+    if (chunk == 0) {
+        chunk = 1;
+    }
+    const size_t chunks = (count + chunk - 1) / chunk;
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->context = context;
+    pool->count = count;
+    pool->chunk = chunk;
+    for (int i = 0; i < pool->thread_count; i++) {
+        // the queues are idle between runs, every worker gets an equal share of chunks
+        pool->queues[i].begin = chunks * i / pool->thread_count;
+        pool->queues[i].end = chunks * (i + 1) / pool->thread_count;
+    }
+    pool->running = pool->thread_count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    while (pool->running > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
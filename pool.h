@@ -0,0 +1,50 @@
+# pragma once
+# ifndef POOL_H
+# define POOL_H
+# include <stddef.h>
+# include <pthread.h>
+# include "base.h"
+
+/// run items [begin, end) on the given worker
+typedef void (*PoolTask)(void *context, int worker, size_t begin, size_t end);
+
+/// chunks [begin, end) still to do by one worker, the owner takes from the front and thieves from the back
+struct PoolQueue {
+    pthread_mutex_t lock;
+    size_t begin;
+    size_t end;
+};
+
+///
+/// Fixed set of worker threads for splitting a range of items.
+///
+/// Pool_run cuts the items into chunks and gives every worker an equal run of them.
+/// A worker that runs out steals half of what is left in another worker's queue,
+/// so a slow chunk does not leave the other threads idle.
+/// The threads live as long as the pool and sleep between runs.
+///
+struct Pool {
+    pthread_t *threads;
+    int thread_count;
+    struct PoolQueue *queues;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start; /// signaled when a run begins or the pool is deleted
+    pthread_cond_t done; /// signaled when the last worker of a run finishes
+    unsigned long generation; /// counts runs, a worker starts when it changes
+    int running; /// workers still busy in this run
+    int quit;
+
+    PoolTask task;
+    void *context;
+    size_t count;
+    size_t chunk;
+};
+
+struct Pool *Pool_create(int thread_count); // 0 for one thread per online cpu
+
+void Pool_delete(struct Pool *pool);
+
+void Pool_run(struct Pool *pool, size_t count, size_t chunk, PoolTask task, void *context); // blocks until done
+
+# endif //POOL_H
@@ -0,0 +1,147 @@
+# include <stdlib.h>
+# include <time.h>
+# include "base.h"
+# include "profile.h"
+
+// Profiler
+// counts and times every statement the tree walker runs, the report sorts them by time and names their lines
+
+# define PROFILE_INIT_SIZE 64
+
+/// Profile.constructor
+struct Profile *Profile_create() {
+    struct Profile *profile = calloc(1, sizeof(struct Profile));
+    if (!profile) {
+        panic("out of memory!", 1)
+    }
+    profile->size = PROFILE_INIT_SIZE;
+    profile->lines = calloc(profile->size, sizeof(struct ProfileLine));
+    if (!profile->lines) {
+        panic("out of memory!", 1)
+    }
+    return profile;
+}
+
+/// Profile.destructor
+void Profile_delete(struct Profile *profile) {
+    free(profile->lines);
+    free(profile);
+}
+
+long long profile_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static unsigned int profile_hash(const int line, const enum DataTag tag) {
+    return (unsigned int) line * 2654435761u ^ (unsigned int) tag;
+}
+
+/// the slot of (line, tag) in lines, a free one if it is not there
+static struct ProfileLine *Profile_find(struct ProfileLine *lines, const int size, const int line,
+                                        const enum DataTag tag) {
+    unsigned int i = profile_hash(line, tag) & (size - 1);
+    while (lines[i].line != 0 && (lines[i].line != line || lines[i].tag != tag)) {
+        i = (i + 1) & (size - 1);
+    }
+    return &lines[i];
+}
+
+static void Profile_grow(struct Profile *profile) {
+    const int size = profile->size * 2;
+    struct ProfileLine *lines = calloc(size, sizeof(struct ProfileLine));
+    if (!lines) {
+        panic("out of memory!", 1)
+    }
+    for (int i = 0; i < profile->size; i++) {
+        if (profile->lines[i].line != 0) {
+            *Profile_find(lines, size, profile->lines[i].line, profile->lines[i].tag) = profile->lines[i];
+        }
+    }
+    free(profile->lines);
+    profile->lines = lines;
+    profile->size = size;
+}
+
+/// add one run of stmt, statements without a line (made up by the parser) count as line 0 of the report
+void profile_statement(struct Profile *profile, const struct Statement *stmt, const long long total,
+                       const long long self) {
+    const int line = stmt->line > 0 ? stmt->line : -1; // 0 marks free slots
+    struct ProfileLine *entry = Profile_find(profile->lines, profile->size, line, stmt->tag);
+    if (entry->line == 0) {
+        if ((profile->count + 1) * 4 > profile->size * 3) {
+            Profile_grow(profile);
+            entry = Profile_find(profile->lines, profile->size, line, stmt->tag);
+        }
+        entry->line = line;
+        entry->tag = stmt->tag;
+        profile->count++;
+    }
+    entry->count++;
+    entry->total += total;
+    entry->self += self;
+}
+
+void profile_builtin(struct Profile *profile, const enum BuiltinId id, const long long time) {
+    profile->builtin_count[id]++;
+    profile->builtin_time[id] += time;
+}
+
+static const char *tag_name(const enum DataTag tag) {
+    switch (tag) {
+        case GIf: return "if";
+        case GWhile: return "while";
+        case GBlock: return "block";
+        default: return "expression";
+    }
+}
+
+/// most self time first, then by line
+static int by_self(const void *a, const void *b) {
+    const struct ProfileLine *x = a;
+    const struct ProfileLine *y = b;
+    if (x->self != y->self) {
+        return x->self < y->self ? 1 : -1;
+    }
+    return x->line - y->line;
+}
+
+/// print the statements sorted by self time, then the builtins that were called
+void Profile_report(const struct Profile *profile, FILE *file) {
+    struct ProfileLine *lines = malloc(sizeof(struct ProfileLine) * (profile->count + 1));
+    if (!lines) {
+        panic("out of memory!", 1)
+    }
+    int count = 0;
+    long long all = 0;
+    for (int i = 0; i < profile->size; i++) {
+        if (profile->lines[i].line != 0) {
+            lines[count++] = profile->lines[i];
+            all += profile->lines[i].self;
+        }
+    }
+    qsort(lines, count, sizeof(struct ProfileLine), by_self);
+
+    fprintf(file, "%6s  %-10s  %12s  %12s  %12s  %6s\n", "line", "statement", "count", "total ms", "self ms", "self%");
+    for (int i = 0; i < count; i++) {
+        const struct ProfileLine *entry = &lines[i];
+        fprintf(file, "%6d  %-10s  %12lld  %12.3f  %12.3f  %5.1f%%\n", entry->line > 0 ? entry->line : 0,
+                tag_name(entry->tag), entry->count, entry->total * 1e-6, entry->self * 1e-6,
+                all > 0 ? 100.0 * entry->self / all : 0.0);
+    }
+
+    int header = 0;
+    for (int id = BuiltinNone + 1; id < BuiltinCount; id++) {
+        if (profile->builtin_count[id] == 0) {
+            continue;
+        }
+        if (!header) {
+            fprintf(file, "\n%-18s  %12s  %12s\n", "builtin", "calls", "total ms");
+            header = 1;
+        }
+        fprintf(file, "%-18s  %12lld  %12.3f\n", builtin_name(id), profile->builtin_count[id],
+                profile->builtin_time[id] * 1e-6);
+    }
+    free(lines);
+}
@@ -0,0 +1,45 @@
+# pragma once
+# ifndef PROFILE_H
+# define PROFILE_H
+# include <stdio.h>
+# include "base.h"
+# include "parser.h"
+
+/// counters of the statements of one kind on one source line
+struct ProfileLine {
+    int line; /// 0 marks a free slot
+    enum DataTag tag; /// GExpression, GIf, GWhile or GBlock
+    long long count;
+    long long total; /// nanoseconds, with the statements run inside it (a while with its body)
+    long long self; /// nanoseconds, without them
+};
+
+///
+/// Execution counts and times per statement and per builtin, for calc --profile.
+///
+/// Only the tree walker records them, interpret_Statement checks Interpreter.profile once and
+/// takes the timed path when it is set. Statements are keyed by line and kind instead of by pointer,
+/// so a profile outlives the ASTs of the REPL. Several statements of one kind on one line add up.
+///
+struct Profile {
+    struct ProfileLine *lines; /// open addressing on (line, tag)
+    int size; /// a power of 2
+    int count;
+    long long inner; /// time of the statements run inside the one being timed, for self
+    long long builtin_count[BuiltinCount];
+    long long builtin_time[BuiltinCount]; /// nanoseconds, with the argument
+};
+
+struct Profile *Profile_create();
+
+void Profile_delete(struct Profile *profile);
+
+long long profile_now(); // monotonic nanoseconds
+
+void profile_statement(struct Profile *profile, const struct Statement *stmt, long long total, long long self);
+
+void profile_builtin(struct Profile *profile, enum BuiltinId id, long long time);
+
+void Profile_report(const struct Profile *profile, FILE *file);
+
+# endif //PROFILE_H
@@ -0,0 +1,16 @@
+# pragma once
+# ifndef REPORT_H
+# define REPORT_H
+
+///
+/// report_error that keeps everything in one object: obj->error gets the code and obj->message the text.
+///
+/// Nothing is printed and nothing global is touched, so objects on different threads never interfere.
+/// The owner decides what to do with the message, WinzigCalc prints it to its error_output.
+/// msg must be a string literal (or live as long as the object).
+///
+# define report(obj, code, msg) { (obj)->error = (code); (obj)->message = (msg); }
+
+# define NAN_MESSAGE "found an nan from calculation, maybe you operated illegally"
+
+# endif //REPORT_H
@@ -0,0 +1,403 @@
+# include <math.h>
+# include <stdlib.h>
+# include <string.h>
+# include "base.h"
+# include "parser.h"
+# include "compiler.h"
+# include "simd.h"
+
+# if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define SIMD_X86 1
+# endif
+
+// Vectorized batch kernels
+// a straight-line Program runs one instruction over a whole block of rows, each kernel is a tight loop over columns
+
+// scalar kernels, also the tail of the vector ones and the only version of pow, & and |
+
+# define SCALAR_BINARY(name, expr) \
+    static void name##_scalar(double *dst, const double *a, const double *b, const int n) { \
+        for (int i = 0; i < n; i++) { \
+            const double x = a[i]; \
+            const double y = b[i]; \
+            dst[i] = (expr); \
+        } \
+    }
+
+SCALAR_BINARY(add, x + y)
+SCALAR_BINARY(sub, x - y)
+SCALAR_BINARY(mul, x * y)
+SCALAR_BINARY(div, x / y)
+SCALAR_BINARY(pow, pow(x, y))
+SCALAR_BINARY(and, truthy(x) && truthy(y))
+SCALAR_BINARY(or, truthy(x) || truthy(y))
+SCALAR_BINARY(lt, x < y)
+SCALAR_BINARY(le, x <= y)
+SCALAR_BINARY(gt, x > y)
+SCALAR_BINARY(ge, x >= y)
+SCALAR_BINARY(eq, x == y)
+SCALAR_BINARY(ne, x != y)
+
+static void sqrt_scalar(double *dst, const double *a, const int n) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = sqrt(a[i]);
+    }
+}
+
+static void abs_scalar(double *dst, const double *a, const int n) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = fabs(a[i]);
+    }
+}
+
+static const struct SimdKernels scalar_kernels = {
+    "scalar",
+    {
+        add_scalar, sub_scalar, mul_scalar, div_scalar, pow_scalar, and_scalar, or_scalar,
+        lt_scalar, le_scalar, gt_scalar, ge_scalar, eq_scalar, ne_scalar,
+    },
+    sqrt_scalar,
+    abs_scalar,
+};
+
+# ifdef SIMD_X86
+
+// sse2, always there on x86-64. comparisons give an all-ones mask, and-ed with 1.0 it becomes 0 or 1 like in calc
+
+# define SSE2_BINARY(name, vexpr, expr) \
+    __attribute__((target("sse2"))) \
+    static void name##_sse2(double *dst, const double *a, const double *b, const int n) { \
+        int i = 0; \
+        for (; i + 2 <= n; i += 2) { \
+            const __m128d x = _mm_loadu_pd(a + i); \
+            const __m128d y = _mm_loadu_pd(b + i); \
+            _mm_storeu_pd(dst + i, (vexpr)); \
+        } \
+        for (; i < n; i++) { \
+            const double x = a[i]; \
+            const double y = b[i]; \
+            dst[i] = (expr); \
+        } \
+    }
+
+# define SSE2_ONE _mm_set1_pd(1.0)
+
+SSE2_BINARY(add, _mm_add_pd(x, y), x + y)
+SSE2_BINARY(sub, _mm_sub_pd(x, y), x - y)
+SSE2_BINARY(mul, _mm_mul_pd(x, y), x * y)
+SSE2_BINARY(div, _mm_div_pd(x, y), x / y)
+SSE2_BINARY(lt, _mm_and_pd(_mm_cmplt_pd(x, y), SSE2_ONE), x < y)
+SSE2_BINARY(le, _mm_and_pd(_mm_cmple_pd(x, y), SSE2_ONE), x <= y)
+SSE2_BINARY(gt, _mm_and_pd(_mm_cmpgt_pd(x, y), SSE2_ONE), x > y)
+SSE2_BINARY(ge, _mm_and_pd(_mm_cmpge_pd(x, y), SSE2_ONE), x >= y)
+SSE2_BINARY(eq, _mm_and_pd(_mm_cmpeq_pd(x, y), SSE2_ONE), x == y)
+SSE2_BINARY(ne, _mm_and_pd(_mm_cmpneq_pd(x, y), SSE2_ONE), x != y) // unordered, true for nan like !=
+
+__attribute__((target("sse2")))
+static void sqrt_sse2(double *dst, const double *a, const int n) {
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(dst + i, _mm_sqrt_pd(_mm_loadu_pd(a + i)));
+    }
+    for (; i < n; i++) {
+        dst[i] = sqrt(a[i]);
+    }
+}
+
+__attribute__((target("sse2")))
+static void abs_sse2(double *dst, const double *a, const int n) {
+    const __m128d mask = _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffLL));
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(dst + i, _mm_and_pd(_mm_loadu_pd(a + i), mask));
+    }
+    for (; i < n; i++) {
+        dst[i] = fabs(a[i]);
+    }
+}
+
+static const struct SimdKernels sse2_kernels = {
+    "sse2",
+    {
+        add_sse2, sub_sse2, mul_sse2, div_sse2, pow_scalar, and_scalar, or_scalar,
+        lt_sse2, le_sse2, gt_sse2, ge_sse2, eq_sse2, ne_sse2,
+    },
+    sqrt_sse2,
+    abs_sse2,
+};
+
+// avx2, 4 doubles per instruction
+
+# define AVX2_BINARY(name, vexpr, expr) \
+    __attribute__((target("avx2"))) \
+    static void name##_avx2(double *dst, const double *a, const double *b, const int n) { \
+        int i = 0; \
+        for (; i + 4 <= n; i += 4) { \
+            const __m256d x = _mm256_loadu_pd(a + i); \
+            const __m256d y = _mm256_loadu_pd(b + i); \
+            _mm256_storeu_pd(dst + i, (vexpr)); \
+        } \
+        for (; i < n; i++) { \
+            const double x = a[i]; \
+            const double y = b[i]; \
+            dst[i] = (expr); \
+        } \
+    }
+
+# define AVX2_CMP(predicate) _mm256_and_pd(_mm256_cmp_pd(x, y, predicate), _mm256_set1_pd(1.0))
+
+AVX2_BINARY(add, _mm256_add_pd(x, y), x + y)
+AVX2_BINARY(sub, _mm256_sub_pd(x, y), x - y)
+AVX2_BINARY(mul, _mm256_mul_pd(x, y), x * y)
+AVX2_BINARY(div, _mm256_div_pd(x, y), x / y)
+AVX2_BINARY(lt, AVX2_CMP(_CMP_LT_OQ), x < y)
+AVX2_BINARY(le, AVX2_CMP(_CMP_LE_OQ), x <= y)
+AVX2_BINARY(gt, AVX2_CMP(_CMP_GT_OQ), x > y)
+AVX2_BINARY(ge, AVX2_CMP(_CMP_GE_OQ), x >= y)
+AVX2_BINARY(eq, AVX2_CMP(_CMP_EQ_OQ), x == y)
+AVX2_BINARY(ne, AVX2_CMP(_CMP_NEQ_UQ), x != y)
+
+__attribute__((target("avx2")))
+static void sqrt_avx2(double *dst, const double *a, const int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_sqrt_pd(_mm256_loadu_pd(a + i)));
+    }
+    for (; i < n; i++) {
+        dst[i] = sqrt(a[i]);
+    }
+}
+
+__attribute__((target("avx2")))
+static void abs_avx2(double *dst, const double *a, const int n) {
+    const __m256d mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_and_pd(_mm256_loadu_pd(a + i), mask));
+    }
+    for (; i < n; i++) {
+        dst[i] = fabs(a[i]);
+    }
+}
+
+static const struct SimdKernels avx2_kernels = {
+    "avx2",
+    {
+        add_avx2, sub_avx2, mul_avx2, div_avx2, pow_scalar, and_scalar, or_scalar,
+        lt_avx2, le_avx2, gt_avx2, ge_avx2, eq_avx2, ne_avx2,
+    },
+    sqrt_avx2,
+    abs_avx2,
+};
+
+# endif
+
+/// the widest kernels this cpu runs
+const struct SimdKernels *simd_kernels() {
+# ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &avx2_kernels;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return &sse2_kernels;
+    }
+# endif
+    return &scalar_kernels;
+}
+
+/// no jumps and no builtin with side effects, so all rows take the same path
+static int is_straight_line(const struct Program *program) {
+    for (int i = 0; i < program->count; i++) {
+        const struct Instr instr = program->code[i];
+        switch (instr.code) {
+            case BcJump:
+            case BcJumpFalse:
+            case BcJumpNotPositive:
+            case BcJumpAnd:
+            case BcJumpOr:
+                return 0;
+            case BcCall:
+                if (!builtin_is_pure(program->funcs[instr.arg])) {
+                    return 0;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return 1;
+}
+
+static double *alloc_columns(const int count) {
+    double *columns = malloc(sizeof(double) * SIMD_BLOCK * (count > 0 ? count : 1));
+    if (!columns) {
+        panic("out of memory!", 1)
+    }
+    return columns;
+}
+
+/**
+ * SimdProgram.constructor
+ *
+ * @param program a compiled program, it must outlive the SimdProgram
+ * @param variable_count number of variable slots the program uses
+ * @return nullptr if the program has branches or impure builtins, run it row by row then
+ */
+struct SimdProgram *SimdProgram_create(const struct Program *program, const int variable_count) {
+    if (!is_straight_line(program)) {
+        return nullptr;
+    }
+    struct SimdProgram *simd = malloc(sizeof(struct SimdProgram));
+    if (!simd) {
+        panic("out of memory!", 1)
+    }
+    simd->program = program;
+    simd->kernels = simd_kernels();
+    simd->variables = alloc_columns(variable_count);
+    simd->variable_count = variable_count;
+    simd->temps = alloc_columns(program->max_depth);
+    simd->consts = alloc_columns(program->const_count);
+    simd->result = alloc_columns(1);
+    simd->stack = malloc(sizeof(double *) * (program->max_depth > 0 ? program->max_depth : 1));
+    if (!simd->stack) {
+        panic("out of memory!", 1)
+    }
+    for (int i = 0; i < program->const_count; i++) {
+        for (int row = 0; row < SIMD_BLOCK; row++) {
+            simd->consts[i * SIMD_BLOCK + row] = (double) program->consts[i];
+        }
+    }
+    return simd;
+}
+
+/// SimdProgram.destructor
+void SimdProgram_delete(struct SimdProgram *simd) {
+    free(simd->variables);
+    free(simd->temps);
+    free(simd->consts);
+    free(simd->result);
+    free(simd->stack);
+    free(simd);
+}
+
+/// variables[slot] = top, first nan row goes to *failed like the MathError of the vm
+static void simd_store(struct SimdProgram *simd, const int depth, const int slot, const int n, int *failed) {
+    double *column = simd->variables + slot * SIMD_BLOCK;
+    double **stack = simd->stack;
+    // a column still on the stack that reads this variable keeps its old value, `b = a + (a = 1)`
+    for (int i = 0; i < depth - 1; i++) {
+        if (stack[i] == column) {
+            double *temp = simd->temps + i * SIMD_BLOCK;
+            memcpy(temp, column, sizeof(double) * n);
+            stack[i] = temp;
+        }
+    }
+    const double *value = stack[depth - 1];
+    if (value != column) {
+        memcpy(column, value, sizeof(double) * n);
+    }
+    for (int row = 0; row < *failed; row++) {
+        if (isnan(column[row])) {
+            *failed = row;
+            break;
+        }
+    }
+}
+
+/**
+ * Run the program on the first n rows of simd->variables
+ *
+ * @param n rows in this block, at most SIMD_BLOCK
+ * @return the first row that assigned a nan, n if every row succeeded
+ */
+int simd_run(struct SimdProgram *simd, const int n) {
+    const struct Program *program = simd->program;
+    const struct SimdKernels *kernels = simd->kernels;
+    const struct Instr *pc = program->code;
+    double **stack = simd->stack;
+    int depth = 0;
+    int failed = n;
+
+# define COLUMN(base, index) ((base) + (index) * SIMD_BLOCK)
+    while (1) {
+        const struct Instr instr = *pc++;
+        switch (instr.code) {
+            case BcHalt:
+                return failed;
+            case BcConst:
+                stack[depth++] = COLUMN(simd->consts, instr.arg);
+                break;
+            case BcLoad:
+                stack[depth++] = COLUMN(simd->variables, instr.arg);
+                break;
+            case BcLoadBelow:
+                stack[depth] = stack[depth - 1];
+                stack[depth - 1] = COLUMN(simd->variables, instr.arg);
+                depth++;
+                break;
+            case BcStore:
+                simd_store(simd, depth, instr.arg, n, &failed);
+                break;
+            case BcAdd: case BcSub: case BcMul: case BcDiv: case BcPow: case BcAnd: case BcOr:
+            case BcLt: case BcLe: case BcGt: case BcGe: case BcEq: case BcNe: {
+                double *dst = COLUMN(simd->temps, depth - 2);
+                kernels->binary[instr.code - BcAdd](dst, stack[depth - 2], stack[depth - 1], n);
+                stack[depth - 2] = dst;
+                depth--;
+                break;
+            }
+            case BcAddK: case BcSubK: case BcMulK: case BcDivK: case BcPowK: case BcAndK: case BcOrK:
+            case BcLtK: case BcLeK: case BcGtK: case BcGeK: case BcEqK: case BcNeK: {
+                double *dst = COLUMN(simd->temps, depth - 1);
+                kernels->binary[instr.code - BcAddK](dst, stack[depth - 1], COLUMN(simd->consts, instr.arg), n);
+                stack[depth - 1] = dst;
+                break;
+            }
+            case BcCall: {
+                Number (*func)(struct Interpreter *, Number) = program->funcs[instr.arg];
+                double *dst = COLUMN(simd->temps, depth - 1);
+                const double *a = stack[depth - 1];
+                for (int row = 0; row < n; row++) {
+                    dst[row] = (double) func(nullptr, a[row]); // pure, it never touches the interpreter
+                }
+                stack[depth - 1] = dst;
+                break;
+            }
+            case BcSqrt:
+                kernels->sqrt(COLUMN(simd->temps, depth - 1), stack[depth - 1], n);
+                stack[depth - 1] = COLUMN(simd->temps, depth - 1);
+                break;
+            case BcAbs:
+                kernels->abs(COLUMN(simd->temps, depth - 1), stack[depth - 1], n);
+                stack[depth - 1] = COLUMN(simd->temps, depth - 1);
+                break;
+            case BcSin: case BcCos: case BcExp: case BcLog: case BcFloor: {
+                const enum BuiltinId id = BuiltinSqrt + (instr.code - BcSqrt);
+                double *dst = COLUMN(simd->temps, depth - 1);
+                const double *a = stack[depth - 1];
+                for (int row = 0; row < n; row++) {
+                    dst[row] = (double) intrinsic_call(id, a[row]);
+                }
+                stack[depth - 1] = dst;
+                break;
+            }
+            case BcResult:
+                memcpy(simd->result, stack[depth - 1], sizeof(double) * n);
+                depth--;
+                break;
+            case BcAssign:
+                simd_store(simd, depth, instr.arg, n, &failed);
+                memcpy(simd->result, stack[depth - 1], sizeof(double) * n);
+                depth--;
+                break;
+            case BcZero:
+                memset(simd->result, 0, sizeof(double) * n);
+                break;
+            default:
+                return 0; // is_straight_line keeps jumps out
+        }
+    }
+# undef COLUMN
+}
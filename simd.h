@@ -0,0 +1,51 @@
+# pragma once
+# ifndef SIMD_H
+# define SIMD_H
+# include "base.h"
+# include "number.h"
+
+struct Program;
+struct Interpreter;
+
+# define SIMD_BLOCK 256 /// rows per block, a multiple of every vector width
+
+/// dst[i] = a[i] op b[i] for i < n, dst may be a or b
+typedef void (*SimdBinary)(double *dst, const double *a, const double *b, int n);
+
+typedef void (*SimdUnary)(double *dst, const double *a, int n);
+
+/// one instruction set, chosen once at runtime by simd_kernels
+struct SimdKernels {
+    const char *name;
+    SimdBinary binary[13]; /// BcAdd .. BcNe
+    SimdUnary sqrt;
+    SimdUnary abs;
+};
+
+const struct SimdKernels *simd_kernels(); // avx2, sse2 or scalar
+
+///
+/// A Program run on SIMD_BLOCK rows at once, in double precision.
+///
+/// Only straight-line programs qualify: no jumps and only pure builtins,
+/// so every row runs the same instructions and each one can process a whole block.
+/// A stack entry is a column of SIMD_BLOCK values instead of a single value.
+///
+struct SimdProgram {
+    const struct Program *program;
+    const struct SimdKernels *kernels;
+    double *variables; /// variables[slot * SIMD_BLOCK + row]
+    int variable_count;
+    double *temps; /// one column per stack depth
+    double *consts; /// consts broadcast to columns, filled once
+    double *result; /// value of the last statement per row
+    double **stack; /// columns on the operand stack, a temp or a variable column
+};
+
+struct SimdProgram *SimdProgram_create(const struct Program *program, int variable_count); // nullptr if not eligible
+
+void SimdProgram_delete(struct SimdProgram *simd);
+
+int simd_run(struct SimdProgram *simd, int n); // run n <= SIMD_BLOCK rows, return the first row that hit a nan, or n
+
+# endif //SIMD_H
@@ -0,0 +1,302 @@
+# include <math.h>
+# include <stdlib.h>
+# include <string.h>
+# include "base.h"
+# include "report.h"
+# include "parser.h"
+# include "symbols.h"
+
+/// Symbols.constructor
+struct Symbols *Symbols_create() {
+    struct Symbols *symbols = malloc(sizeof(struct Symbols));
+    if (!symbols) {
+        panic("out of memory!", 1)
+    }
+    symbols->names = nullptr;
+    symbols->defined = nullptr;
+    symbols->count = 0;
+    symbols->size = 0;
+    symbols->capacity = 0;
+    symbols->table = nullptr;
+    symbols->fresh = nullptr;
+    symbols->fresh_count = 0;
+    symbols->fresh_size = 0;
+    return symbols;
+}
+
+/// Symbols.destructor
+void Symbols_delete(struct Symbols *symbols) {
+    for (int i = 0; i < symbols->count; i++) {
+        free(symbols->names[i]);
+    }
+    free(symbols->names);
+    free(symbols->defined);
+    free(symbols->table);
+    free(symbols->fresh);
+    free(symbols);
+}
+
+/// FNV-1a, names are short
+static unsigned int name_hash(const char *name) {
+    unsigned int hash = 2166136261u;
+    while (*name) {
+        hash ^= (unsigned char) *name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/// bucket of name, or the empty bucket where it should go
+static struct SymbolEntry *Symbols_probe(const struct Symbols *symbols, const char *name, const unsigned int hash) {
+    const unsigned int mask = symbols->capacity - 1;
+    unsigned int i = hash & mask;
+    while (1) {
+        struct SymbolEntry *entry = &symbols->table[i];
+        if (entry->slot < 0) {
+            return entry;
+        }
+        if (entry->hash == hash && strcmp(symbols->names[entry->slot], name) == 0) {
+            return entry;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+/// double the bucket table and put every name back
+static void Symbols_grow(struct Symbols *symbols) {
+    struct SymbolEntry *old = symbols->table;
+    const unsigned int old_capacity = symbols->capacity;
+    symbols->capacity = old_capacity ? old_capacity * 2 : 64;
+    symbols->table = malloc(sizeof(struct SymbolEntry) * symbols->capacity);
+    if (!symbols->table) {
+        panic("out of memory!", 1)
+    }
+    memset(symbols->table, -1, sizeof(struct SymbolEntry) * symbols->capacity); // slot = -1
+    for (unsigned int i = 0; i < old_capacity; i++) {
+        if (old[i].slot >= 0) {
+            const unsigned int mask = symbols->capacity - 1;
+            unsigned int j = old[i].hash & mask;
+            while (symbols->table[j].slot >= 0) {
+                j = (j + 1) & mask;
+            }
+            symbols->table[j] = old[i];
+        }
+    }
+    free(old);
+}
+
+int Symbols_find(const struct Symbols *symbols, const char *name) {
+    if (symbols->capacity == 0) {
+        return -1;
+    }
+    return Symbols_probe(symbols, name, name_hash(name))->slot;
+}
+
+int Symbols_intern(struct Symbols *symbols, const char *name) {
+    if ((unsigned int) (symbols->count + 1) * 4 > symbols->capacity * 3) {
+        Symbols_grow(symbols);
+    }
+    const unsigned int hash = name_hash(name);
+    struct SymbolEntry *entry = Symbols_probe(symbols, name, hash);
+    if (entry->slot >= 0) {
+        return entry->slot;
+    }
+    entry->hash = hash;
+    entry->slot = symbols->count;
+
+    if (symbols->count >= symbols->size) {
+        symbols->size = symbols->size ? symbols->size * 2 : 16;
+        void *new_names = realloc(symbols->names, sizeof(char *) * symbols->size);
+        void *new_defined = realloc(symbols->defined, sizeof(char) * symbols->size);
+        if (!new_names || !new_defined) {
+            panic("out of memory!", 1)
+        }
+        symbols->names = new_names;
+        symbols->defined = new_defined;
+    }
+    symbols->names[symbols->count] = malloc(strlen(name) + 1);
+    strcpy(symbols->names[symbols->count], name);
+    symbols->defined[symbols->count] = 0;
+    return symbols->count++;
+}
+
+/**
+ * Undo the definitions of the last resolve_file after its entry failed, so a later read is reported again
+ * instead of reading the nan of a variable that was never assigned
+ *
+ * @param variables the variables of the interpreter after the failed run, a slot that got a value stays defined;
+ *                  nullptr undoes every definition (the entry never ran)
+ */
+void Symbols_rollback(struct Symbols *symbols, const Number *variables, const int variable_count) {
+    for (int i = 0; i < symbols->fresh_count; i++) {
+        const int slot = symbols->fresh[i];
+        if (variables == nullptr || slot >= variable_count || isnan(variables[slot])) {
+            symbols->defined[slot] = 0;
+        }
+    }
+    symbols->fresh_count = 0;
+}
+
+// Resolver
+// gives every Identifier its slot and checks that a variable is definitely assigned before it is read:
+// on every path, in source order. with that done at compile time, reading a variable is just an array index.
+// defined[] is the set of the path being resolved, fresh[] logs what this file added so a branch can be undone.
+
+static void resolve_Block(struct Parser *parser, struct Symbols *symbols, struct Block *block);
+
+static void define(struct Symbols *symbols, const int slot) {
+    if (symbols->defined[slot]) {
+        return;
+    }
+    symbols->defined[slot] = 1;
+    if (symbols->fresh_count >= symbols->fresh_size) {
+        symbols->fresh_size = symbols->fresh_size ? symbols->fresh_size * 2 : 16;
+        void *new_memory = realloc(symbols->fresh, sizeof(int) * symbols->fresh_size);
+        if (!new_memory) {
+            panic("out of memory!", 1)
+        }
+        symbols->fresh = new_memory;
+    }
+    symbols->fresh[symbols->fresh_count++] = slot;
+}
+
+/// undefine what was defined since mark, for code that may not run: a loop body, the rhs of & |
+static void forget(struct Symbols *symbols, const int mark) {
+    for (int i = mark; i < symbols->fresh_count; i++) {
+        symbols->defined[symbols->fresh[i]] = 0;
+    }
+    symbols->fresh_count = mark;
+}
+
+/// the branches of an if: after it, a variable is defined only if both of them define it
+static void resolve_branches(struct Parser *parser, struct Symbols *symbols, const struct If *if_stmt) {
+    const int mark = symbols->fresh_count;
+    if (if_stmt->cond->tag == GLiteral) {
+        // `if (1)` always takes one branch, only that one counts, as interpret_Statement picks it
+        const int then_taken = !(if_stmt->cond->literal->value < eps);
+        resolve_Block(parser, symbols, if_stmt->then_block);
+        if (!then_taken) {
+            forget(symbols, mark);
+        }
+        const int else_mark = symbols->fresh_count;
+        resolve_Block(parser, symbols, if_stmt->else_block);
+        if (then_taken) {
+            forget(symbols, else_mark);
+        }
+        return;
+    }
+    resolve_Block(parser, symbols, if_stmt->then_block);
+    const int then_count = symbols->fresh_count - mark;
+    int *then_slots = malloc(sizeof(int) * (then_count > 0 ? then_count : 1));
+    if (!then_slots) {
+        panic("out of memory!", 1)
+    }
+    memcpy(then_slots, symbols->fresh + mark, sizeof(int) * then_count);
+    forget(symbols, mark);
+
+    resolve_Block(parser, symbols, if_stmt->else_block);
+    for (int i = 0; i < then_count; i++) {
+        symbols->defined[then_slots[i]] += 2; // 3 in both branches, 2 only in then
+    }
+    int kept = mark;
+    for (int i = mark; i < symbols->fresh_count; i++) {
+        const int slot = symbols->fresh[i];
+        if (symbols->defined[slot] == 3) {
+            symbols->fresh[kept++] = slot;
+        } else {
+            symbols->defined[slot] = 0;
+        }
+    }
+    symbols->fresh_count = kept;
+    for (int i = 0; i < then_count; i++) {
+        symbols->defined[then_slots[i]] = symbols->defined[then_slots[i]] == 3;
+    }
+    free(then_slots);
+}
+
+static void resolve_Expression(struct Parser *parser, struct Symbols *symbols, struct Expression *expr) {
+    switch (expr->tag) {
+        case GIdentifier: {
+            const int slot = Symbols_intern(symbols, expr->identifier->name);
+            if (!symbols->defined[slot]) {
+                report(parser, SyntaxError, "variable is not defined");
+            }
+            expr->identifier->slot = slot;
+            return;
+        }
+        case GBuiltin:
+            resolve_Expression(parser, symbols, expr->builtin->expr);
+            return;
+        case GExpr2:
+            break;
+        default:
+            return;
+    }
+
+    struct Expr2 *expr2 = expr->expr2;
+    if (expr2->op == OpAnd || expr2->op == OpOr) {
+        resolve_Expression(parser, symbols, expr2->lhs);
+        const int mark = symbols->fresh_count;
+        resolve_Expression(parser, symbols, expr2->rhs);
+        forget(symbols, mark); // the lhs may decide without running it
+        return;
+    }
+    if (!is_assign_op(expr2->op) || expr2->lhs->tag != GIdentifier) {
+        resolve_Expression(parser, symbols, expr2->lhs);
+        resolve_Expression(parser, symbols, expr2->rhs);
+        return;
+    }
+    // the value is evaluated first, `a = a + 1` still needs an earlier a
+    resolve_Expression(parser, symbols, expr2->rhs);
+    if (expr2->op == OpAssign) {
+        const int slot = Symbols_intern(symbols, expr2->lhs->identifier->name);
+        define(symbols, slot);
+        expr2->lhs->identifier->slot = slot;
+    } else {
+        resolve_Expression(parser, symbols, expr2->lhs); // a += 1 reads a
+    }
+}
+
+static void resolve_Statement(struct Parser *parser, struct Symbols *symbols, struct Statement *stmt) {
+    switch (stmt->tag) {
+        case GExpression:
+            resolve_Expression(parser, symbols, stmt->expr);
+            break;
+        case GBlock:
+            resolve_Block(parser, symbols, stmt->block);
+            break;
+        case GIf:
+            resolve_Expression(parser, symbols, stmt->if_stmt->cond);
+            resolve_branches(parser, symbols, stmt->if_stmt);
+            break;
+        case GWhile: {
+            resolve_Expression(parser, symbols, stmt->while_stmt->cond); // runs at least once
+            const int mark = symbols->fresh_count;
+            resolve_Block(parser, symbols, stmt->while_stmt->block);
+            forget(symbols, mark); // the body may run zero times
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void resolve_Block(struct Parser *parser, struct Symbols *symbols, struct Block *block) {
+    for (struct Statement **stmt = block->stmts; stmt[0]->tag != GNull; stmt++) {
+        resolve_Statement(parser, symbols, *stmt);
+    }
+}
+
+/**
+ * Resolve all variables of parser->result_block to slots
+ *
+ * @param parser a parser after a successful parse_file, error is set to SyntaxError for undefined variables
+ * @param symbols the symbol table of the interpreter that will run the block, nothing new stays defined on error
+ */
+void resolve_file(struct Parser *parser, struct Symbols *symbols) {
+    symbols->fresh_count = 0;
+    resolve_Block(parser, symbols, parser->result_block);
+    if (parser->error != Running && parser->error != Success) {
+        Symbols_rollback(symbols, nullptr, 0);
+    }
+}
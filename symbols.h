@@ -0,0 +1,52 @@
+# pragma once
+# ifndef SYMBOLS_H
+# define SYMBOLS_H
+# include "base.h"
+# include "number.h"
+
+struct Parser;
+struct Block;
+
+/// one bucket of the name index, slot -1 means empty
+struct SymbolEntry {
+    unsigned int hash;
+    int slot;
+};
+
+///
+/// Variable names and their slots.
+///
+/// Every distinct name gets a dense slot index, the interpreter keeps its variables in an array of that size.
+/// It lives as long as the interpreter, so the slots stay valid between lines in the repl.
+///
+/// Names are found through an open addressing table with linear probing.
+/// A bucket is 8 bytes and keeps the full hash, so a probe rarely has to compare a name,
+/// and the table doubles before it is 3/4 full.
+///
+struct Symbols {
+    char **names; /// names[slot], the stored keys
+    char *defined; /// defined[slot], set once an assignment to it was resolved on every path to here
+    int count;
+    int size;
+
+    int *fresh; /// slots the last resolve_file defined, see Symbols_rollback
+    int fresh_count;
+    int fresh_size;
+
+    struct SymbolEntry *table;
+    unsigned int capacity; /// power of 2
+};
+
+struct Symbols *Symbols_create();
+
+void Symbols_delete(struct Symbols *symbols);
+
+int Symbols_find(const struct Symbols *symbols, const char *name); // -1 if not found
+int Symbols_intern(struct Symbols *symbols, const char *name); // find or add
+
+void Symbols_rollback(struct Symbols *symbols, const Number *variables, int variable_count);
+
+
+void resolve_file(struct Parser *parser, struct Symbols *symbols); // after parse_file, fills Identifier.slot
+
+# endif //SYMBOLS_H
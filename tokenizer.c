@@ -3,9 +3,66 @@
 # include <string.h>
 
 # include "base.h"
+# include "report.h"
 # include "tokenizer.h"
 
 
+const char *const operator_names[OpCount] = {
+    "", "+", "-", "*", "/", "^", "&", "|",
+    "<", "<=", ">", ">=", "==", "!=",
+    "!",
+    "=", "+=", "-=", "*=", "/=", "^=", "&=", "|=",
+    "(", ")", "{", "}",
+};
+
+/// classify an operator token, OpNone if it is not one we know
+enum Operator operator_of(const char *token, const unsigned long len) {
+    if (len == 1) {
+        switch (token[0]) {
+            case '+': return OpAdd;
+            case '-': return OpSub;
+            case '*': return OpMul;
+            case '/': return OpDiv;
+            case '^': return OpPow;
+            case '&': return OpAnd;
+            case '|': return OpOr;
+            case '<': return OpLt;
+            case '>': return OpGt;
+            case '!': return OpNot;
+            case '=': return OpAssign;
+            case '(': return OpLParen;
+            case ')': return OpRParen;
+            case '{': return OpLBrace;
+            case '}': return OpRBrace;
+            default: return OpNone;
+        }
+    }
+    if (len == 2 && token[1] == '=') {
+        switch (token[0]) {
+            case '<': return OpLe;
+            case '>': return OpGe;
+            case '=': return OpEq;
+            case '!': return OpNe;
+            case '+': return OpAddAssign;
+            case '-': return OpSubAssign;
+            case '*': return OpMulAssign;
+            case '/': return OpDivAssign;
+            case '^': return OpPowAssign;
+            case '&': return OpAndAssign;
+            case '|': return OpOrAssign;
+            default: return OpNone;
+        }
+    }
+    return OpNone;
+}
+
+enum Keyword keyword_of(const char *token, const unsigned long len) {
+    if (len == 2 && strncmp(token, "if", 2) == 0) return KwIf;
+    if (len == 4 && strncmp(token, "else", 4) == 0) return KwElse;
+    if (len == 5 && strncmp(token, "while", 5) == 0) return KwWhile;
+    return KwNone;
+}
+
 /// TokenData.constructor
 struct TokenData *Ts_create() {
     struct TokenData *tokens = malloc(sizeof(struct TokenData));
@@ -18,12 +75,14 @@ struct TokenData *Ts_create() {
     tokens->count = 0;
     tokens->size = INIT_TOKEN_COUNT;
     tokens->error = Running;
+    tokens->message = nullptr;
     tokens->index = 0;
+    tokens->line = 1;
     return tokens;
 }
 
-/// TokenData.push: push a token
-void Ts_push(struct TokenData *tokens, const enum DataTag tag, const char *const token, unsigned long token_len) {
+/// TokenData.push: push a token, it points into the source, nothing is copied
+void Ts_push(struct TokenData *tokens, enum TokenType tag, const char *const token, unsigned long token_len) {
     if (!tokens) {
         return;
     }
@@ -39,15 +98,29 @@ void Ts_push(struct TokenData *tokens, const enum DataTag tag, const char *const
         tokens->tokens = new_memory;
     }
 
-    tokens->tokens[tokens->count].tag = tag;
-    tokens->tokens[tokens->count].token = malloc((token_len + 1) * sizeof(char));
-    strcpy(tokens->tokens[tokens->count].token, token);
+    struct Token *pushed = &tokens->tokens[tokens->count];
+    pushed->op = OpNone;
+    if (tag == TokenOperator) {
+        pushed->op = operator_of(token, token_len);
+        if (pushed->op == OpNone) {
+            report(tokens, SyntaxError, "unknown operator");
+        }
+    } else if (tag == TokenWord) {
+        pushed->keyword = keyword_of(token, token_len);
+        if (pushed->keyword != KwNone) {
+            tag = TokenKeyword;
+        }
+    }
+    pushed->tag = tag;
+    pushed->token = token;
+    pushed->length = (int) token_len;
+    pushed->line = tokens->line;
     tokens->count++;
 }
 
 /// TokenData.end: end the token list, submit
 void Ts_end(struct TokenData *tokens) {
-    Ts_push(tokens, TokenNull, "", 1);
+    Ts_push(tokens, TokenNull, "", 0);
     // it will never push then
     // void* new_memory = realloc(tokens->tokens, sizeof(struct Token) * (tokens->count + 2));
     // if (!new_memory) {
@@ -68,7 +141,9 @@ void Ts_delete(struct TokenData *tokens) {
 void Ts_refresh(struct TokenData *tokens) {
     tokens->index = 0;
     tokens->count = 0;
+    tokens->line = 1;
     tokens->error = Running;
+    tokens->message = nullptr;
 }
 
 /// for parser. pop a token.
@@ -78,6 +153,9 @@ struct Token Ts_pop(struct TokenData *tokens) {
         struct Token token;
         token.tag = TokenNull;
         token.token = "";
+        token.length = 0;
+        token.line = 0;
+        token.op = OpNone;
         return token;
     }
     return tokens->tokens[tokens->index++];
@@ -90,6 +168,9 @@ struct Token Ts_peek(struct TokenData *tokens) {
         struct Token token;
         token.tag = TokenNull;
         token.token = "";
+        token.length = 0;
+        token.line = 0;
+        token.op = OpNone;
         return token; // we'd better keep this for further check
     }
     return tokens->tokens[tokens->index];
@@ -99,6 +180,11 @@ void Ts_advance(struct TokenData *tokens) {
     tokens->index++;
 }
 
+/// compare a token with a NUL terminated string
+int Token_equals(const struct Token token, const char *str) {
+    return strncmp(token.token, str, token.length) == 0 && str[token.length] == '\0';
+}
+
 /**
  * Tokenize the source code
  *
@@ -107,26 +193,35 @@ void Ts_advance(struct TokenData *tokens) {
  * @return a list of tokens (ends with "\0")
  */
 void tokenize(struct TokenData *tokens, const char *src) {
+    tokenize_n(tokens, src, src == NULL ? 0 : strlen(src));
+}
+
+/**
+ * Tokenize length bytes of source code, src does not need a '\0' (e.g. a mmap'd file)
+ *
+ * tokens point into src, keep it alive until parsing is done
+ */
+void tokenize_n(struct TokenData *tokens, const char *src, const unsigned long length) {
     /// OK
     /// Passed test on 2024-11-06 22:07
     enum TokenType state = TokenNull;
     // Null for initial or blank, Word for word, Number for number, Operator for operator
 
-    char *token = malloc(sizeof(char) * MAX_TOKEN_LEN); // assume never exceed MAX_TOKEN_LEN. what hell can be so long?
+    // the current token is the slice [token, token + token_len) of src, chars of one token are always adjacent
+    const char *token = src;
     unsigned long token_len = 0;
-#define PUSH_CHAR(c) token[token_len++] = c
+#define PUSH_CHAR(c) if (token_len++ == 0) token = src
 #define PUSH_TOKEN(tag) \
     if (token_len > 0){\
-        ;\
-        PUSH_CHAR('\0');\
         Ts_push(tokens, tag, token, token_len);\
         token_len = 0;\
     }
 
-    if (src == NULL || *src == '\0') {
+    if (src == NULL || length == 0) {
         Ts_end(tokens);
         return;
     }
+    const char *const end = src + length;
     do {
         if (*src == ' ' || *src == '\t') {
             PUSH_TOKEN(state);
@@ -135,8 +230,11 @@ void tokenize(struct TokenData *tokens, const char *src) {
         }
         if (*src == '\n' || *src == '\r' || *src == ';') {
             PUSH_TOKEN(state);
-            Ts_push(tokens, TokenLineSep, ";", 1);
-            while (*src == '\n' || *src == '\r' || *src == ';') src++;
+            Ts_push(tokens, TokenLineSep, src, 1);
+            while (src < end && (*src == '\n' || *src == '\r' || *src == ';')) {
+                tokens->line += *src == '\n';
+                src++;
+            }
             state = TokenNull;
             src--;
             continue;
@@ -188,7 +286,7 @@ void tokenize(struct TokenData *tokens, const char *src) {
                 state = TokenNull;
             } else {
                 if (state == TokenOperator) {
-                    report_error(tokens->error, SyntaxError, "two operators in a row");
+                    report(tokens, SyntaxError, "two operators in a row");
                     break;
                 }
                 PUSH_CHAR(*src);
@@ -205,14 +303,14 @@ void tokenize(struct TokenData *tokens, const char *src) {
             state = TokenNull;
             continue;
         }
-        if (*src != '\0') {
-            report_error(tokens->error, InvalidChar, "invalid character");
-            break;
+        if (*src == '\0') {
+            break; // a '\0' still ends the source
         }
-    } while (*++src != '\0');
+        report(tokens, InvalidChar, "invalid character");
+        break;
+    } while (++src < end);
     PUSH_TOKEN(state);
     Ts_end(tokens);
-    free(token);
 #undef PUSH_CHAR
 #undef PUSH_TOKEN
 }
@@ -6,11 +6,48 @@
 enum TokenType {
     TokenNull, // used for state mark, don't use in real token
     TokenWord, TokenNumber, TokenOperator, TokenLineSep,
+    TokenKeyword, // a TokenWord that is a keyword, set by Ts_push
 };
 
+///
+/// Operators, recognized by the tokenizer so nobody after it looks at the characters again.
+///
+/// The order matters:
+/// OpAdd..OpNe match BcAdd..BcNe in compiler.h,
+/// OpAddAssign..OpOrAssign match OpAdd..OpOr (see assign_base).
+///
+enum Operator {
+    OpNone,
+    OpAdd, OpSub, OpMul, OpDiv, OpPow, OpAnd, OpOr,
+    OpLt, OpLe, OpGt, OpGe, OpEq, OpNe,
+    OpNot,
+    OpAssign,
+    OpAddAssign, OpSubAssign, OpMulAssign, OpDivAssign, OpPowAssign, OpAndAssign, OpOrAssign,
+    OpLParen, OpRParen, OpLBrace, OpRBrace,
+    OpCount,
+};
+
+# define is_assign_op(op) ((op) >= OpAssign && (op) <= OpOrAssign)
+# define assign_base(op) ((op) - OpAddAssign + OpAdd) // OpAddAssign -> OpAdd, only for op= operators
+
+extern const char *const operator_names[OpCount];
+
+enum Keyword {
+    KwNone, KwIf, KwElse, KwWhile,
+};
+
+/// A slice of the source, token is not NUL terminated, use length.
+/// The source must outlive the TokenData (until parsing is done).
 struct Token {
     enum TokenType tag;
-    char *token;
+    const char *token;
+    int length;
+    int line; /// 1 based source line, 0 for the tokens Ts_pop and Ts_peek make up past the end
+
+    union {
+        enum Operator op; /// TokenOperator
+        enum Keyword keyword; /// TokenKeyword
+    };
 };
 
 struct TokenData {
@@ -19,11 +56,13 @@ struct TokenData {
     int size; /// using in malloc or reallocate
     // int error;
     enum Error error; /// 0 for no err, 1 for grammar, 2 for invalid char, -1 for internal error
+    const char *message; /// text of the last error, see report.h
     int index; /// current index, for pop
+    int line; /// line of the next pushed token, tokenize counts the newlines
 };
 
 struct TokenData *Ts_create();
-void Ts_push(struct TokenData *tokens, enum DataTag tag, const char *token, unsigned long token_len);
+void Ts_push(struct TokenData *tokens, enum TokenType tag, const char *token, unsigned long token_len);
 void Ts_delete(struct TokenData *tokens);
 void Ts_end(struct TokenData *tokens);
 struct Token Ts_pop(struct TokenData *tokens);
@@ -31,6 +70,10 @@ struct Token Ts_peek(struct TokenData *tokens);
 void Ts_advance(struct TokenData *tokens);
 void Ts_refresh(struct TokenData *tokens);
 
+int Token_equals(struct Token token, const char *str);
+
 void tokenize(struct TokenData *tokens, const char *src);
 
+void tokenize_n(struct TokenData *tokens, const char *src, unsigned long length);
+
 #endif //TOKENIZER_H
@@ -0,0 +1,161 @@
+# include <math.h>
+# include <stdlib.h>
+# include "base.h"
+# include "report.h"
+# include "interpreter.h"
+# include "compiler.h"
+
+// Bytecode vm
+// runs a Program from compile_file with a single dispatch loop, no recursion and no string compare
+
+/**
+ * Run a compiled program
+ *
+ * @return the value of the last statement, like interpret_Block
+ */
+Number interpret_Program(struct Interpreter *interpreter, const struct Program *program) {
+    if (interpreter->stack_size < program->max_depth) {
+        void *new_memory = realloc(interpreter->stack, sizeof(Number) * program->max_depth);
+        if (!new_memory) {
+            panic("out of memory!", 1)
+        }
+        interpreter->stack = new_memory;
+        interpreter->stack_size = program->max_depth;
+    }
+
+    const struct Instr *const code = program->code;
+    const Number *const consts = program->consts;
+    Number *const variables = interpreter->variables;
+    // the top of the stack is cached in tos, the rest lives in interpreter->stack.
+    // keeping it out of memory saves a store and a reload of an 80 bit value on nearly every instruction
+    Number tos = 0;
+    Number *sp = interpreter->stack; // points to the next free cell below tos
+    const struct Instr *pc = code;
+    Number rv = 0;
+
+# define PUSH(value) { *sp++ = tos; tos = (value); }
+# define BINARY(expr) { const Number b = tos; const Number a = *--sp; tos = (expr); break; }
+# define BINARY_K(expr) { const Number b = consts[instr.arg]; const Number a = tos; tos = (expr); break; }
+    while (1) {
+        const struct Instr instr = *pc++;
+        switch (instr.code) {
+            case BcHalt:
+                return rv;
+            case BcConst:
+                PUSH(consts[instr.arg])
+                break;
+            case BcLoad:
+                PUSH(variables[instr.arg]) // resolve_file checked it is defined
+                break;
+            case BcLoadBelow:
+                *sp++ = variables[instr.arg]; // tos stays on top
+                break;
+            case BcStore:
+                variables[instr.arg] = tos;
+                if (isnan(tos)) {
+                    report(interpreter, MathError, NAN_MESSAGE);
+                    return rv; // the run stops at the first error, see interpret_Block
+                }
+                break;
+            case BcAdd: BINARY(a + b)
+            case BcSub: BINARY(a - b)
+            case BcMul: BINARY(a * b)
+            case BcDiv: BINARY(a / b)
+            case BcPow: BINARY(NUM(pow)(a, b))
+            case BcAnd: BINARY(truthy(a) && truthy(b))
+            case BcOr: BINARY(truthy(a) || truthy(b))
+            case BcLt: BINARY(a < b)
+            case BcLe: BINARY(a <= b)
+            case BcGt: BINARY(a > b)
+            case BcGe: BINARY(a >= b)
+            case BcEq: BINARY(a == b)
+            case BcNe: BINARY(a != b)
+            case BcAddK: BINARY_K(a + b)
+            case BcSubK: BINARY_K(a - b)
+            case BcMulK: BINARY_K(a * b)
+            case BcDivK: BINARY_K(a / b)
+            case BcPowK: BINARY_K(NUM(pow)(a, b))
+            case BcAndK: BINARY_K(truthy(a) && truthy(b))
+            case BcOrK: BINARY_K(truthy(a) || truthy(b))
+            case BcLtK: BINARY_K(a < b)
+            case BcLeK: BINARY_K(a <= b)
+            case BcGtK: BINARY_K(a > b)
+            case BcGeK: BINARY_K(a >= b)
+            case BcEqK: BINARY_K(a == b)
+            case BcNeK: BINARY_K(a != b)
+            case BcCall:
+                tos = program->funcs[instr.arg](interpreter, tos);
+                if (interpreter->error != Running) {
+                    return rv; // input() got q, exit() or an error inside the function
+                }
+                break;
+            case BcSqrt: tos = NUM(sqrt)(tos); break;
+            case BcAbs: tos = NUM(fabs)(tos); break;
+            case BcSin: tos = NUM(sin)(tos); break;
+            case BcCos: tos = NUM(cos)(tos); break;
+            case BcExp: tos = NUM(exp)(tos); break;
+            case BcLog: tos = NUM(log)(tos); break;
+            case BcFloor: tos = NUM(floor)(tos); break;
+            case BcResult:
+                rv = tos;
+                tos = *--sp;
+                break;
+            case BcAssign:
+                variables[instr.arg] = tos;
+                if (isnan(tos)) {
+                    report(interpreter, MathError, NAN_MESSAGE);
+                    return rv;
+                }
+                rv = tos;
+                tos = *--sp;
+                break;
+            case BcZero:
+                rv = 0;
+                break;
+            case BcJump:
+                pc = code + instr.arg;
+                break;
+            case BcJumpFalse:
+                if (tos < eps) {
+                    pc = code + instr.arg;
+                }
+                tos = *--sp;
+                break;
+            case BcJumpNotPositive:
+                if (!(tos > eps)) {
+                    pc = code + instr.arg;
+                }
+                tos = *--sp;
+                break;
+            case BcJumpAnd:
+                if (!truthy(tos)) {
+                    tos = 0;
+                    pc = code + instr.arg;
+                } else {
+                    tos = *--sp;
+                }
+                break;
+            case BcJumpOr:
+                if (truthy(tos)) {
+                    tos = 1;
+                    pc = code + instr.arg;
+                } else {
+                    tos = *--sp;
+                }
+                break;
+            case BcTruth:
+                tos = truthy(tos);
+                break;
+            case BcHoist:
+                variables[instr.arg] = tos; // a nan here only matters if the loop uses it, then that store reports it
+                tos = *--sp;
+                break;
+            default:
+                report(interpreter, RuntimeError, "Unknown bytecode");
+                return rv;
+        }
+    }
+# undef PUSH
+# undef BINARY
+# undef BINARY_K
+}
@@ -2,17 +2,45 @@
 # include "tokenizer.h"
 # include "parser.h"
 # include "interpreter.h"
+# include "symbols.h"
+# include "optimizer.h"
+# include "compiler.h"
+# include "cache.h"
+# include "profile.h"
+# include "wzc.h"
+# include "input.h"
+# include "output.h"
 # include "winzig_calc.h"
 
+#include <ctype.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+# define FILE_CHUNK_SIZE (64 * 1024)
 
 
 struct WinzigCalc *WinzigCalc_create() {
     struct WinzigCalc *calc = malloc(sizeof(struct WinzigCalc));
+    if (!calc) {
+        panic("out of memory!", 1)
+    }
     calc->tokens = Ts_create();
     calc->parser = Parser_create();
     calc->interpreter = Interpreter_create();
+    calc->optimize = 1;
+    calc->print_ast = 1;
+    calc->error = Running;
+    calc->message = nullptr;
+    calc->error_output = stderr;
+    calc->cache = nullptr;
+    calc->cache_optimize = calc->optimize;
+    calc->entry = nullptr;
+    calc->entry_size = 0;
     return calc;
 }
 
@@ -20,86 +48,484 @@ void WinzigCalc_delete(struct WinzigCalc *calc) {
     Ts_delete(calc->tokens);
     Parser_delete(calc->parser);
     Interpreter_delete(calc->interpreter);
+    if (calc->cache) {
+        ProgramCache_delete(calc->cache);
+    }
+    free(calc->entry);
     free(calc);
 }
 
-void winzig_inline(struct WinzigCalc *calc) {
-    /// read 1 line and execute, then reset errors
-    Ts_refresh(calc->tokens);
-    Parser_refresh(calc->parser);
-    Interpreter_refresh(calc->interpreter);
+/// keep the error of a stage in calc and print its message, 1 if the stage succeeded
+static int WinzigCalc_check(struct WinzigCalc *calc, const enum Error error, const char *message) {
+    calc->error = error;
+    calc->message = message;
+    if (error == Success) {
+        return 1;
+    }
+    // a failed compile or run leaves the variables it never assigned undefined again
+    Symbols_rollback(calc->interpreter->symbols, calc->interpreter->variables, calc->interpreter->variable_count);
+    if (message && calc->error_output) {
+        fprintf(calc->error_output, "Error: %s\n", message);
+    }
+    return 0;
+}
+
+/// tokens to an optimized tree in calc->parser, every stage stops at its first error
+static int WinzigCalc_front(struct WinzigCalc *calc) {
+    if (!WinzigCalc_check(calc, calc->tokens->error, calc->tokens->message)) {
+        return 0;
+    }
+    parse_file(calc->parser, calc->tokens);
+    if (!WinzigCalc_check(calc, calc->parser->error, calc->parser->message)) {
+        return 0;
+    }
+    resolve_file(calc->parser, calc->interpreter->symbols);
+    if (!WinzigCalc_check(calc, calc->parser->error, calc->parser->message)) {
+        return 0;
+    }
+    if (calc->optimize) {
+        optimize_file(calc->parser, calc->interpreter->symbols);
+    }
+    return 1;
+}
 
-    printf(">>> ");
-    fflush(stdout);
-    char buf[256];
-    fgets(buf, 256, stdin);
+/// tokens to result
+static int WinzigCalc_run(struct WinzigCalc *calc, Number *result) {
+    if (!WinzigCalc_front(calc)) {
+        return 0;
+    }
+    *result = interpret_file(calc->interpreter, calc->parser->result_block);
+    return WinzigCalc_check(calc, calc->interpreter->error, calc->interpreter->message);
+}
 
-    // check keyboard interrupt
-    if (strstr(buf, "exit")) {
-        calc->error = KeyboardInterrupt;
+/// winzig_source through calc->cache, a hit skips tokenize, parse, resolve, optimize and compile
+static void winzig_cached(struct WinzigCalc *calc, const char *code, const size_t length) {
+    if (calc->cache_optimize != calc->optimize) {
+        ProgramCache_clear(calc->cache); // the programs were compiled from trees optimized the other way
+        calc->cache_optimize = calc->optimize;
+    }
+    const unsigned long long hash = source_hash(code, length);
+    const struct Program *program = ProgramCache_find(calc->cache, code, length, hash);
+    if (program) {
+        interpret_compiled(calc->interpreter, program);
+        WinzigCalc_check(calc, calc->interpreter->error, calc->interpreter->message);
         return;
     }
 
-    tokenize(calc->tokens, buf);
-    calc->error = calc->tokens->error;
-    if (calc->error != Success) return;
+    tokenize_n(calc->tokens, code, length);
+    if (!WinzigCalc_front(calc)) {
+        return;
+    }
+    struct Program *compiled = Program_create();
+    compile_file(compiled, calc->parser->result_block);
+    if (!WinzigCalc_check(calc, compiled->error, compiled->message)) {
+        Program_delete(compiled);
+        return;
+    }
+    interpret_compiled(calc->interpreter, compiled);
+    WinzigCalc_check(calc, calc->interpreter->error, calc->interpreter->message);
+    ProgramCache_insert(calc->cache, code, length, hash, compiled); // also when the run failed, the code is fine
+}
 
-    parse_file(calc->parser, calc->tokens);
-    calc->error = calc->parser->error;
-    if (calc->error != Success) return;
+/**
+ * Cache compiled scripts in calc, winzig_code with a source seen before runs its program right away
+ *
+ * Only for the bytecode mode, --walk always runs the front end.
+ * A hit has no tree, so print_ast is ignored while the cache is on, on a miss too: the output of a script
+ * must not depend on whether it was seen before. Changing calc->optimize clears the cache.
+ *
+ * @param max_bytes memory for cached programs and their sources, 0 turns the cache off
+ */
+void WinzigCalc_enable_cache(struct WinzigCalc *calc, const size_t max_bytes) {
+    if (calc->cache) {
+        ProgramCache_delete(calc->cache);
+        calc->cache = nullptr;
+    }
+    if (max_bytes > 0) {
+        calc->cache = ProgramCache_create(max_bytes);
+        calc->cache_optimize = calc->optimize;
+    }
+}
+
+enum EntryState {
+    EntryDone, /// the tokens end a statement, run them
+    EntryBlock, /// a { or an if / while / else waits for more statements, lines are joined with a newline
+    EntryExpression, /// a ( or an operator waits for its operand, lines are joined with a space
+};
+
+/// what entry_state has seen of the tokens of a repl entry, so every line only scans its own tokens
+struct EntryScan {
+    int scanned; /// tokens looked at
+    int parens;
+    int braces;
+    int header_parens; /// parens the condition of the last if / while opens at, -1 for none
+    int after_header; /// the last token closed that condition
+    int last; /// index of the last token that is not a separator, -1 for none
+};
 
-    long double result = interpret_file(calc->interpreter, calc->parser->result_block);
-    calc->error = calc->interpreter->error;
-    if (calc->error != Success) return;
+/// Whether the tokens stop in the middle of a statement, so the repl asks for another line
+static enum EntryState entry_state(struct EntryScan *scan, const struct TokenData *tokens) {
+    for (; scan->scanned < tokens->count; scan->scanned++) {
+        const struct Token *token = &tokens->tokens[scan->scanned];
+        if (token->tag == TokenNull || token->tag == TokenLineSep) {
+            continue;
+        }
+        scan->after_header = 0;
+        if (token->tag == TokenKeyword && (token->keyword == KwIf || token->keyword == KwWhile)) {
+            scan->header_parens = scan->parens;
+        } else if (token->tag == TokenOperator) {
+            scan->parens += (token->op == OpLParen) - (token->op == OpRParen);
+            scan->braces += (token->op == OpLBrace) - (token->op == OpRBrace);
+            if (token->op == OpRParen && scan->parens == scan->header_parens) {
+                scan->after_header = 1;
+                scan->header_parens = -1;
+            }
+        }
+        scan->last = scan->scanned;
+    }
+    if (scan->last < 0) {
+        return EntryDone;
+    }
+    const struct Token *last = &tokens->tokens[scan->last];
+    if (scan->parens > 0 || (last->tag == TokenOperator && last->op != OpRParen && last->op != OpLBrace &&
+                             last->op != OpRBrace)) {
+        return EntryExpression;
+    }
+    if (scan->braces > 0 || scan->after_header || (last->tag == TokenKeyword && last->keyword == KwElse)) {
+        return EntryBlock;
+    }
+    return EntryDone;
+}
 
-    printf("%Lf\n", result);
+/// a line that is only the word, surrounded by blanks
+static int line_is(const char *line, size_t length, const char *word) {
+    while (length > 0 && isspace((unsigned char) line[0])) {
+        line++;
+        length--;
+    }
+    while (length > 0 && isspace((unsigned char) line[length - 1])) {
+        length--;
+    }
+    return length == strlen(word) && strncmp(line, word, length) == 0;
 }
 
-void winzig_repl(struct WinzigCalc *calc) {
+static void repl_prompt(const struct WinzigCalc *calc, const char *prompt) {
+    if (calc->interpreter->input->interactive) {
+        output_write(calc->interpreter->output, prompt, strlen(prompt));
+    }
+    Output_flush(calc->interpreter->output);
+}
+
+/**
+ * Read one entry of the repl and run it, `exit`, exit() or the end of the input set KeyboardInterrupt
+ *
+ * An entry is one line, or more while entry_state says the statement goes on: an open ( or {,
+ * a trailing operator, or an if / while / else without its body. Lines have no length limit and come from
+ * interpreter->input, the same buffer input() reads. Each line is tokenized once, onto the tokens of the lines
+ * before it, and those tokens are what runs. Symbols and variables stay in the interpreter,
+ * every entry is resolved against them and only its own tree and bytecode are built.
+ */
+void winzig_inline(struct WinzigCalc *calc) {
+    struct Input *input = calc->interpreter->input;
+    struct TokenData *tokens = calc->tokens;
+    struct EntryScan scan = {0, 0, 0, -1, 0, -1};
+    size_t used = 0;
+    Ts_refresh(tokens);
+    repl_prompt(calc, ">>> ");
     while (1) {
-        winzig_inline(calc);
-        if (calc->error == KeyboardInterrupt) {
-            break;
+        size_t length;
+        const char *line = input_line(input, &length);
+        if (line == nullptr) {
+            if (used == 0) {
+                calc->error = KeyboardInterrupt; // the end of the input
+                return;
+            }
+            break; // run what was typed before it, the parser reports what is missing
+        }
+        if (used == 0 && (line_is(line, length, "exit") || line_is(line, length, "quit"))) {
+            calc->error = KeyboardInterrupt;
+            return;
         }
+        if (used == 0 && line_is(line, length, "")) {
+            repl_prompt(calc, ">>> ");
+            continue;
+        }
+        if (used + length + 1 > calc->entry_size) {
+            const uintptr_t old = (uintptr_t) calc->entry;
+            calc->entry_size = (used + length + 1) * 2;
+            void *new_memory = realloc(calc->entry, calc->entry_size);
+            if (!new_memory) {
+                panic("out of memory!", 1)
+            }
+            calc->entry = new_memory;
+            for (int i = 0; i < tokens->count; i++) {
+                // the tokens of the earlier lines point into the old buffer
+                if (tokens->tokens[i].tag != TokenNull) {
+                    tokens->tokens[i].token = calc->entry + ((uintptr_t) tokens->tokens[i].token - old);
+                }
+            }
+        }
+        memcpy(calc->entry + used, line, length);
+        calc->entry[used + length] = '\n';
+
+        // only the new line is tokenized, appended in place of the TokenNull that ended the earlier ones
+        const int first = tokens->count > 0 ? tokens->count - 1 : 0;
+        tokens->count = first;
+        tokens->error = Running;
+        scan.scanned = first;
+        tokenize_n(tokens, calc->entry + used, length + 1);
+        if (first > 0 && tokens->tokens[first - 1].tag == TokenLineSep && tokens->tokens[first].tag == TokenLineSep) {
+            // one separator for a run of them, as the tokenizer does within a line (a blank line inside a block)
+            memmove(&tokens->tokens[first], &tokens->tokens[first + 1], sizeof(struct Token) * (tokens->count - first - 1));
+            tokens->count--;
+        }
+        used += length + 1;
+        const enum EntryState state = entry_state(&scan, tokens);
+        if (state == EntryDone || tokens->error != Success) {
+            break; // a complete statement, or one the tokenizer already rejects
+        }
+        if (state == EntryExpression && tokens->tokens[tokens->count - 2].tag == TokenLineSep) {
+            // a newline would end the statement: drop its separator, keeping the TokenNull after it
+            tokens->tokens[tokens->count - 2] = tokens->tokens[tokens->count - 1];
+            tokens->count--;
+            calc->entry[used - 1] = ' ';
+        }
+        repl_prompt(calc, "... ");
+    }
+
+    Parser_refresh(calc->parser);
+    Interpreter_refresh(calc->interpreter);
+    Number result;
+    if (WinzigCalc_run(calc, &result)) {
+        output_number(calc->interpreter->output, result);
+        Output_flush(calc->interpreter->output);
+    }
+}
+
+void winzig_repl(struct WinzigCalc *calc) {
+    calc->error = Success;
+    while (calc->error != KeyboardInterrupt) {
+        winzig_inline(calc);
     }
 }
 
 void winzig_code(struct WinzigCalc *calc, char *code) {
-    tokenize(calc->tokens, code);
-    if (calc->tokens->error != Success) {
-        // printf("Tokenize error: %d\n", calc->tokens->error); // reported error inside.
+    winzig_source(calc, code, strlen(code));
+}
+
+/// run length bytes of source, code does not need to end with '\0'
+void winzig_source(struct WinzigCalc *calc, const char *code, const size_t length) {
+    Ts_refresh(calc->tokens);
+    Parser_refresh(calc->parser);
+    Interpreter_refresh(calc->interpreter);
+    if (calc->cache && calc->interpreter->mode == ModeBytecode) {
+        winzig_cached(calc, code, length);
         return;
     }
-    parse_file(calc->parser, calc->tokens);
-    if (calc->parser->error != Success) {
-        // printf("Parse error: %d\n", calc->parser->error);// reported error inside.
+    tokenize_n(calc->tokens, code, length);
+    Number result;
+    if (WinzigCalc_run(calc, &result) && calc->print_ast) {
+        print_Block(calc->interpreter->output, calc->parser->result_block);
+        Output_flush(calc->interpreter->output);
+    }
+}
+
+/// read a pipe or other unmappable file in chunks, the caller frees the buffer
+char *read_all(const int fd, size_t *length) {
+    size_t size = FILE_CHUNK_SIZE;
+    size_t used = 0;
+    char *buf = malloc(size);
+    if (!buf) {
+        panic("out of memory!", 1)
+    }
+    while (1) {
+        if (size - used < FILE_CHUNK_SIZE) {
+            size *= 2;
+            void *new_memory = realloc(buf, size);
+            if (!new_memory) {
+                panic("out of memory!", 1)
+            }
+            buf = new_memory;
+        }
+        const ssize_t n = read(fd, buf + used, FILE_CHUNK_SIZE);
+        if (n <= 0) {
+            break;
+        }
+        used += n;
+    }
+    *length = used;
+    return buf;
+}
+
+/// the bytes of a script file, see file_open
+struct FileData {
+    char *data;
+    size_t length;
+    int mapped; /// munmap instead of free
+};
+
+/**
+ * Read a whole file
+ *
+ * Regular files are mmap'd, nothing is copied and there is no size limit.
+ * Pipes and other files that can't be mapped are read in chunks.
+ *
+ * @return 0 if the file can't be opened
+ */
+static int file_open(struct FileData *file, const char *filename) {
+    const int fd = strcmp(filename, "-") == 0 ? STDIN_FILENO : open(filename, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    file->data = nullptr;
+    file->length = 0;
+    file->mapped = 0;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            close(fd);
+            return 1;
+        }
+        char *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            close(fd);
+            madvise(data, st.st_size, MADV_SEQUENTIAL); // read once from front to back
+            file->data = data;
+            file->length = st.st_size;
+            file->mapped = 1;
+            return 1;
+        }
+    }
+    file->data = read_all(fd, &file->length);
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    return 1;
+}
+
+static void file_close(struct FileData *file) {
+    if (file->mapped) {
+        munmap(file->data, file->length);
+    } else {
+        free(file->data);
+    }
+}
+
+/// run the Program in a .wzc file on the vm, straight from its bytes
+static void winzig_wzc(struct WinzigCalc *calc, const char *data, const size_t length) {
+    Interpreter_refresh(calc->interpreter);
+    if (calc->interpreter->mode != ModeBytecode) {
+        WinzigCalc_check(calc, RuntimeError, "a compiled program only runs on the vm, use the source");
         return;
     }
-    interpret_file(calc->interpreter, calc->parser->result_block);
-    if (calc->interpreter->error != Success) {
-        // printf("Interpret error: %d\n", calc->interpreter->error); // reported error inside.
+    struct Program program;
+    const char *message = nullptr;
+    if (!wzc_load(&program, data, length, calc->interpreter->symbols, &message)) {
+        WinzigCalc_check(calc, RuntimeError, message);
         return;
     }
-    print_Block(calc->parser->result_block);
+    interpret_compiled(calc->interpreter, &program);
+    WinzigCalc_check(calc, calc->interpreter->error, calc->interpreter->message);
+    wzc_release(&program);
 }
 
+/**
+ * Run a script file, or a program compiled by winzig_compile (found by its header, not by its name)
+ *
+ * Scripts are tokenized in place, a compiled program runs from the mapping without being copied.
+ * A file that cannot be opened is a RuntimeError in calc->error and calc->message, like any failed run.
+ */
 void winzig_file(struct WinzigCalc *calc, char *filename) {
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
-        printf("Cannot open file %s\n", filename);
+    struct FileData file;
+    if (!file_open(&file, filename)) {
+        WinzigCalc_check(calc, RuntimeError, "cannot open file");
         return;
     }
-    char buf[65536];
-    fread(buf, 1, 65536, fp);
-    winzig_code(calc, buf);
+    if (file.length >= 4 && memcmp(file.data, WZC_MAGIC, 4) == 0) {
+        winzig_wzc(calc, file.data, file.length);
+    } else {
+        winzig_source(calc, file.length ? file.data : "", file.length);
+    }
+    file_close(&file);
+}
+
+/**
+ * Compile a script file to a .wzc file instead of running it, calc --compile in.wz -o out.wzc
+ *
+ * @return 1 on success, otherwise calc->error and calc->message tell why
+ */
+int winzig_compile(struct WinzigCalc *calc, const char *filename, const char *output) {
+    struct FileData file;
+    if (!file_open(&file, filename)) {
+        return WinzigCalc_check(calc, RuntimeError, "cannot open the script");
+    }
+    Ts_refresh(calc->tokens);
+    Parser_refresh(calc->parser);
+    Interpreter_refresh(calc->interpreter);
+    tokenize_n(calc->tokens, file.data, file.length);
+    const int done = WinzigCalc_front(calc);
+    if (done) {
+        Program_refresh(calc->interpreter->program);
+        compile_file(calc->interpreter->program, calc->parser->result_block); // the tokens point into file
+    }
+    file_close(&file);
+    if (!done || !WinzigCalc_check(calc, calc->interpreter->program->error, calc->interpreter->program->message)) {
+        return 0;
+    }
+    const char *message = nullptr;
+    if (!wzc_write(calc->interpreter->program, calc->interpreter->symbols, output, &message)) {
+        return WinzigCalc_check(calc, RuntimeError, message);
+    }
+    return 1;
 }
 
 int winzig_ez_main(int argc, char *argv[]) {
     struct WinzigCalc *calc = WinzigCalc_create();
-    if (argc == 1) {
+    char *filename = nullptr;
+    int compile = 0;
+    const char *output = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--walk") == 0) {
+            // reference mode: walk the AST instead of running bytecode, for comparing results
+            calc->interpreter->mode = ModeTreeWalk;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            // the walker with hot while loops compiled to native code, only does something in the double build
+            calc->interpreter->mode = ModeJit;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            // count and time every statement, the report goes to stderr at exit
+            calc->interpreter->profile = Profile_create();
+        } else if (strcmp(argv[i], "--compile") == 0) {
+            // write the bytecode to a .wzc file instead of running, calc runs that file without the front end
+            compile = 1;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--no-opt") == 0) {
+            // skip optimize_file, to diff optimized and unoptimized results
+            calc->optimize = 0;
+        } else {
+            filename = argv[i];
+        }
+    }
+    if (calc->interpreter->profile && calc->interpreter->mode == ModeBytecode) {
+        calc->interpreter->mode = ModeTreeWalk; // only the walker sees statements
+    }
+    if (compile) {
+        if (filename == nullptr || output == nullptr) {
+            printf("usage: calc --compile <file> -o <file.wzc>\n");
+            WinzigCalc_delete(calc);
+            return 1;
+        }
+        const int done = winzig_compile(calc, filename, output);
+        WinzigCalc_delete(calc);
+        return done ? 0 : 1;
+    }
+    if (filename == nullptr) {
         winzig_repl(calc);
     } else {
-        winzig_file(calc, argv[1]);
+        winzig_file(calc, filename);
+    }
+    if (calc->interpreter->profile) {
+        Profile_report(calc->interpreter->profile, stderr);
     }
     WinzigCalc_delete(calc);
     return 0;
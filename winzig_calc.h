@@ -1,19 +1,39 @@
 # pragma once
 # ifndef WINZIG_CALC_H
 # define WINZIG_CALC_H
+# include <stddef.h>
+# include <stdio.h>
 # include "base.h"
 
+///
+/// One embedded calculator.
+///
+/// Every piece of mutable state lives in the object: variables, random() state, the print() and input() streams
+/// (interpreter->output and interpreter->input) and the last error. Instances share nothing,
+/// so they can run on different threads at the same time, one thread per instance.
+///
 struct WinzigCalc {
     struct TokenData *tokens;
     struct Parser *parser;
     struct Interpreter *interpreter;
+    int optimize; /// run optimize_file before interpreting, on by default
+    int print_ast; /// print the AST after winzig_code to the interpreter's output, for debugging, on by default,
+                   /// ignored while the cache is on
     enum Error error;
+    const char *message; /// text of the last error, nullptr if there is none
+    FILE *error_output; /// error messages are printed here, stderr by default, nullptr to print nothing
+    struct ProgramCache *cache; /// compiled scripts by source, off (nullptr) by default, see WinzigCalc_enable_cache
+    int cache_optimize; /// optimize as it was when the cached programs were compiled
+    char *entry; /// source of the repl entry being read, kept and grown to the longest one
+    size_t entry_size;
 };
 
 struct WinzigCalc *WinzigCalc_create();
 
 void WinzigCalc_delete(struct WinzigCalc *calc);
 
+void WinzigCalc_enable_cache(struct WinzigCalc *calc, size_t max_bytes);
+
 void winzig_inline(struct WinzigCalc *calc);
 
 void winzig_repl(struct WinzigCalc *calc);
@@ -22,6 +42,10 @@ int winzig_ez_main(int argc, char *argv[]);
 
 void winzig_code(struct WinzigCalc *calc, char *code);
 
+void winzig_source(struct WinzigCalc *calc, const char *code, size_t length);
+
 void winzig_file(struct WinzigCalc *calc, char *filename);
 
+int winzig_compile(struct WinzigCalc *calc, const char *filename, const char *output);
+
 # endif //WINZIG_CALC_H
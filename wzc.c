@@ -0,0 +1,332 @@
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include "base.h"
+# include "number.h"
+# include "parser.h"
+# include "compiler.h"
+# include "symbols.h"
+# include "cache.h"
+# include "wzc.h"
+
+// Compiled program files
+// a Program written out as it is in memory, loading one checks it and points a Program into the mapping
+
+# define WZC_BYTE_ORDER 0x01020304u
+
+static uint64_t wzc_align(const uint64_t offset) {
+    return (offset + 15) & ~(uint64_t) 15;
+}
+
+/// the BuiltinId of a function in program->funcs, BuiltinNone if it is not a builtin
+static enum BuiltinId wzc_builtin_id(Number (*func)(struct Interpreter *, Number)) {
+    for (int id = BuiltinNone + 1; id < BuiltinCount; id++) {
+        const struct BuiltinInfo *info = builtin_of(id);
+        if (info && info->func == func) {
+            return id;
+        }
+    }
+    return BuiltinNone;
+}
+
+/// hash of the header with checksum counted as 0, mixed with the hash of the sections after it
+static uint64_t wzc_checksum(const struct WzcHeader *header, const char *file, const uint64_t length) {
+    struct WzcHeader summed = *header;
+    summed.checksum = 0;
+    return source_hash((const char *) &summed, sizeof(struct WzcHeader)) * 0x9e3779b97f4a7c15ULL ^
+           source_hash(file + sizeof(struct WzcHeader), length - sizeof(struct WzcHeader));
+}
+
+/**
+ * Write a compiled program to filename
+ *
+ * @param program a program from compile_file without errors
+ * @param symbols the symbols it was resolved with, every slot gets its name in the file
+ * @param message set to the reason on failure
+ */
+int wzc_write(const struct Program *program, const struct Symbols *symbols, const char *filename,
+              const char **message) {
+    struct WzcHeader header = {0};
+    memcpy(header.magic, WZC_MAGIC, 4);
+    header.version = WZC_VERSION;
+    header.number_size = sizeof(Number);
+    header.byte_order = WZC_BYTE_ORDER;
+    header.code_count = program->count;
+    header.const_count = program->const_count;
+    header.func_count = program->func_count;
+    header.symbol_count = symbols->count;
+    header.max_depth = program->max_depth;
+    for (int slot = 0; slot < symbols->count; slot++) {
+        header.names_bytes += strlen(symbols->names[slot]) + 1;
+    }
+    header.const_offset = wzc_align(sizeof(struct WzcHeader));
+    header.code_offset = wzc_align(header.const_offset + sizeof(Number) * header.const_count);
+    header.func_offset = wzc_align(header.code_offset + sizeof(struct Instr) * header.code_count);
+    header.names_offset = wzc_align(header.func_offset + sizeof(int32_t) * header.func_count);
+    header.length = header.names_offset + header.names_bytes;
+
+    char *file = calloc(1, header.length); // the gaps between sections stay 0
+    if (!file) {
+        panic("out of memory!", 1)
+    }
+    memcpy(file + header.const_offset, program->consts, sizeof(Number) * header.const_count);
+    memcpy(file + header.code_offset, program->code, sizeof(struct Instr) * header.code_count);
+    for (int i = 0; i < program->func_count; i++) {
+        const int32_t id = wzc_builtin_id(program->funcs[i]);
+        if (id == BuiltinNone) {
+            free(file);
+            *message = "the program calls a function that is not a builtin";
+            return 0;
+        }
+        memcpy(file + header.func_offset + sizeof(int32_t) * i, &id, sizeof(int32_t));
+    }
+    char *name = file + header.names_offset;
+    for (int slot = 0; slot < symbols->count; slot++) {
+        const size_t length = strlen(symbols->names[slot]) + 1;
+        memcpy(name, symbols->names[slot], length);
+        name += length;
+    }
+    header.checksum = wzc_checksum(&header, file, header.length);
+    memcpy(file, &header, sizeof(struct WzcHeader));
+
+    FILE *output = fopen(filename, "wb");
+    if (!output) {
+        free(file);
+        *message = "cannot open the output file";
+        return 0;
+    }
+    const int written = fwrite(file, 1, header.length, output) == header.length;
+    free(file);
+    if (fclose(output) != 0 || !written) {
+        *message = "cannot write the output file";
+        return 0;
+    }
+    return 1;
+}
+
+/// count items of size bytes at offset fit in a file of length bytes
+static int wzc_fits(const uint64_t offset, const uint64_t count, const uint64_t size, const uint64_t length) {
+    return offset % 16 == 0 && offset <= length && count <= (length - offset) / size;
+}
+
+/// values an instruction reads from the operand stack
+static int wzc_operands(const enum ByteCode code) {
+    switch (code) {
+        case BcHalt: case BcConst: case BcLoad: case BcZero: case BcJump:
+            return 0;
+        case BcAdd: case BcSub: case BcMul: case BcDiv: case BcPow: case BcAnd: case BcOr:
+        case BcLt: case BcLe: case BcGt: case BcGe: case BcEq: case BcNe:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+/**
+ * Walk every path through the code with the stack depth of compile_file (stack_effect),
+ * 0 if an instruction pops more than there is, two paths meet with different depths or max_depth is exceeded
+ *
+ * Runs after wzc_check_code, jumps are known to stay inside the code.
+ *
+ * @param deepest set to the largest depth any path reaches, the stack the vm really needs
+ */
+static int wzc_check_depth(const struct Instr *code, const struct WzcHeader *header, int *deepest) {
+    const uint32_t count = header->code_count;
+    if (header->max_depth > (uint64_t) count + 1) {
+        return 0; // every instruction pushes at most one value, a larger header would only size a huge stack
+    }
+    int *depths = malloc(sizeof(int) * count); // -1 until a path reaches the instruction
+    uint32_t *pending = malloc(sizeof(uint32_t) * count);
+    if (!depths || !pending) {
+        panic("out of memory!", 1)
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        depths[i] = -1;
+    }
+    int valid = 1;
+    int pending_count = 0;
+    *deepest = 0;
+    depths[0] = 0;
+    pending[pending_count++] = 0;
+# define REACH(target, depth) \
+    if (depths[target] == -1) { \
+        depths[target] = (depth); \
+        pending[pending_count++] = (target); \
+    } else if (depths[target] != (depth)) { \
+        valid = 0; \
+    }
+    while (valid && pending_count > 0) {
+        const uint32_t pc = pending[--pending_count];
+        const struct Instr instr = code[pc];
+        const int depth = depths[pc];
+        const int after = depth + stack_effect(instr.code);
+        if (depth < wzc_operands(instr.code) || after > (int) header->max_depth) {
+            valid = 0;
+            break;
+        }
+        if (after > *deepest) {
+            *deepest = after;
+        }
+        switch (instr.code) {
+            case BcHalt:
+                break;
+            case BcJump:
+                REACH(instr.arg, depth)
+                break;
+            case BcJumpAnd: // the jump keeps the value, the fall through pops it
+            case BcJumpOr:
+                REACH(instr.arg, depth)
+                REACH(pc + 1, after)
+                break;
+            case BcJumpFalse:
+            case BcJumpNotPositive:
+                REACH(instr.arg, after)
+                REACH(pc + 1, after)
+                break;
+            default:
+                REACH(pc + 1, after) // not past the end, the last instruction is BcHalt
+                break;
+        }
+    }
+# undef REACH
+    free(depths);
+    free(pending);
+    return valid;
+}
+
+/// every arg in range, jumps inside the code, the last instruction is BcHalt
+static int wzc_check_code(const struct Instr *code, const struct WzcHeader *header) {
+    if (header->code_count == 0 || code[header->code_count - 1].code != BcHalt) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < header->code_count; i++) {
+        const struct Instr instr = code[i];
+        uint32_t limit;
+        switch (instr.code) {
+            case BcConst:
+            case BcAddK: case BcSubK: case BcMulK: case BcDivK: case BcPowK: case BcAndK: case BcOrK:
+            case BcLtK: case BcLeK: case BcGtK: case BcGeK: case BcEqK: case BcNeK:
+                limit = header->const_count;
+                break;
+            case BcLoad: case BcLoadBelow: case BcStore: case BcAssign: case BcHoist:
+                limit = header->symbol_count;
+                break;
+            case BcCall:
+                limit = header->func_count;
+                break;
+            case BcJump: case BcJumpFalse: case BcJumpNotPositive: case BcJumpAnd: case BcJumpOr:
+                limit = header->code_count;
+                break;
+            default:
+                if ((unsigned int) instr.code >= BcCount) {
+                    return 0;
+                }
+                continue; // no arg
+        }
+        if (instr.arg < 0 || (uint32_t) instr.arg >= limit) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Load a compiled program from the bytes of a .wzc file, without copying them
+ *
+ * The header, checksum, every instruction and the stack depth along every path are checked,
+ * so the vm can run the code unchecked. Then program->code and program->consts
+ * point into data, which has to stay mapped (and 16 byte aligned, an mmap is) while the program runs.
+ * The variable names are interned into symbols, they must get the slots they had when the file was written,
+ * which holds for a fresh interpreter.
+ *
+ * @param program an unused Program, filled in; give it back with wzc_release, not Program_delete
+ * @param message set to the reason on failure
+ */
+int wzc_load(struct Program *program, const char *data, const size_t length, struct Symbols *symbols,
+             const char **message) {
+    if ((uintptr_t) data % 16 != 0) {
+        *message = "compiled program is not 16 byte aligned in memory";
+        return 0;
+    }
+    const struct WzcHeader *header = (const struct WzcHeader *) data;
+    if (length < sizeof(struct WzcHeader) || memcmp(header->magic, WZC_MAGIC, 4) != 0) {
+        *message = "not a compiled program";
+        return 0;
+    }
+    if (header->version != WZC_VERSION || header->byte_order != WZC_BYTE_ORDER) {
+        *message = "compiled program of another version, compile it again";
+        return 0;
+    }
+    if (header->number_size != sizeof(Number)) {
+        *message = "compiled program of a build with another number type";
+        return 0;
+    }
+    if (header->length != length ||
+        !wzc_fits(header->const_offset, header->const_count, sizeof(Number), length) ||
+        !wzc_fits(header->code_offset, header->code_count, sizeof(struct Instr), length) ||
+        !wzc_fits(header->func_offset, header->func_count, sizeof(int32_t), length) ||
+        !wzc_fits(header->names_offset, header->names_bytes, 1, length)) {
+        *message = "compiled program is truncated or damaged";
+        return 0;
+    }
+    if (wzc_checksum(header, data, length) != header->checksum) {
+        *message = "compiled program fails its checksum";
+        return 0;
+    }
+    const struct Instr *code = (const struct Instr *) (data + header->code_offset);
+    int max_depth;
+    if (!wzc_check_code(code, header) || !wzc_check_depth(code, header, &max_depth)) {
+        *message = "compiled program has invalid instructions";
+        return 0;
+    }
+
+    Number (**funcs)(struct Interpreter *, Number) = malloc(sizeof(*funcs) * (header->func_count + 1));
+    if (!funcs) {
+        panic("out of memory!", 1)
+    }
+    for (uint32_t i = 0; i < header->func_count; i++) {
+        int32_t id;
+        memcpy(&id, data + header->func_offset + sizeof(int32_t) * i, sizeof(int32_t));
+        const struct BuiltinInfo *info = id > BuiltinNone && id < BuiltinCount ? builtin_of(id) : nullptr;
+        if (!info) {
+            free(funcs);
+            *message = "compiled program calls an unknown builtin";
+            return 0;
+        }
+        funcs[i] = info->func;
+    }
+    const char *name = data + header->names_offset;
+    const char *names_end = name + header->names_bytes;
+    for (uint32_t slot = 0; slot < header->symbol_count; slot++) {
+        const char *end = memchr(name, '\0', names_end - name);
+        if (!end || Symbols_intern(symbols, name) != (int) slot) {
+            free(funcs);
+            *message = end ? "the variables of the interpreter don't match the compiled program"
+                           : "compiled program is truncated or damaged";
+            return 0;
+        }
+        symbols->defined[slot] = 1;
+        name = end + 1;
+    }
+
+    program->code = (struct Instr *) code;
+    program->count = (int) header->code_count;
+    program->size = 0;
+    program->consts = (Number *) (data + header->const_offset);
+    program->const_count = (int) header->const_count;
+    program->const_size = 0;
+    program->funcs = funcs;
+    program->func_count = (int) header->func_count;
+    program->func_size = (int) header->func_count;
+    program->depth = 0;
+    program->max_depth = max_depth; // what the code needs, not what the header claims
+    program->error = Success;
+    program->message = nullptr;
+    return 1;
+}
+
+/// free what wzc_load allocated, the mapped code and consts belong to the caller
+void wzc_release(struct Program *program) {
+    free(program->funcs);
+    program->funcs = nullptr;
+}
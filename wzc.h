@@ -0,0 +1,57 @@
+# pragma once
+# ifndef WZC_H
+# define WZC_H
+# include <stddef.h>
+# include <stdint.h>
+# include "base.h"
+
+struct Program;
+struct Symbols;
+
+# define WZC_MAGIC "WZC\n"
+
+/// bump it whenever enum ByteCode, struct Instr or the layout below changes, old files are refused
+# define WZC_VERSION 2
+
+///
+/// Header of a compiled program file (.wzc), written by calc --compile.
+///
+/// The file is the Program of compile_file as it is in memory, so it runs straight from an mmap:
+///   header | consts (Number[const_count]) | code (struct Instr[code_count]) | funcs (BuiltinId[func_count])
+///   | names (symbol_count NUL terminated variable names, in slot order)
+/// Sections start at 16 byte aligned offsets. Nothing in it is a pointer; builtins are stored by BuiltinId
+/// and variables by slot, the names give the slots back to the symbols of the interpreter that loads it.
+///
+/// A file only loads into the same build: same version, byte order and Number type.
+/// Loading checks the sizes, the checksum, that every instruction stays inside the file's arrays
+/// and that no path through the code needs a deeper operand stack than max_depth; the vm gets the stack the code
+/// really needs, a max_depth larger than code_count + 1 is rejected.
+///
+struct WzcHeader {
+    char magic[4]; /// WZC_MAGIC
+    uint32_t version; /// WZC_VERSION
+    uint32_t number_size; /// sizeof(Number), long double and double builds can't read each other's files
+    uint32_t byte_order; /// 0x01020304 as the writer stored it
+    uint64_t length; /// the whole file
+    uint64_t checksum; /// source_hash (cache.h) of the whole file, this field counted as 0
+    uint32_t code_count;
+    uint32_t const_count;
+    uint32_t func_count;
+    uint32_t symbol_count;
+    uint32_t max_depth;
+    uint32_t names_bytes;
+    uint64_t const_offset;
+    uint64_t code_offset;
+    uint64_t func_offset;
+    uint64_t names_offset;
+};
+
+int wzc_write(const struct Program *program, const struct Symbols *symbols, const char *filename,
+              const char **message); // 1 on success
+
+int wzc_load(struct Program *program, const char *data, size_t length, struct Symbols *symbols,
+             const char **message); // 1 on success, program points into data, see wzc_release
+
+void wzc_release(struct Program *program);
+
+# endif //WZC_H